@@ -0,0 +1,123 @@
+/**
+ * @file bench_calloc.c
+ * @brief calloc heavy workload on tkl_system_calloc
+ * @version 0.1
+ * @date 2021-05-05
+ *
+ * @copyright Copyright 2021 Tuya Inc. All Rights Reserved.
+ *
+ * Allocates rounds of large zeroed receive buffers, fills a quarter of each
+ * like a receiver would and frees them again. Each round is run with tkl_system_calloc, with tkl_system_malloc +
+ * memset (what calloc did before the heap tracked zero memory) and with the
+ * glibc calloc for reference. Memory the heap knows is zero is mostly fresh
+ * mmap'd pages, whose page faults then move from calloc to the first write,
+ * so the whole round is timed as well.
+ *
+ * usage: bench_calloc [buffer size] [buffers per round] [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tkl_memory.h"
+#include "tuya_mem_heap.h"
+
+typedef enum {
+    BENCH_TKL_CALLOC = 0,
+    BENCH_TKL_MALLOC_MEMSET,
+    BENCH_LIBC_CALLOC,
+    BENCH_MAX
+} BENCH_MODE_E;
+
+static const char *s_mode_name[BENCH_MAX] = {"tkl_calloc", "tkl_malloc+memset", "libc_calloc"};
+
+static double __now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void *__alloc(BENCH_MODE_E mode, size_t size)
+{
+    void *ptr = NULL;
+
+    switch (mode) {
+    case BENCH_TKL_CALLOC:
+        return tkl_system_calloc(1, size);
+    case BENCH_TKL_MALLOC_MEMSET:
+        ptr = tkl_system_malloc(size);
+        if (ptr) {
+            memset(ptr, 0, size);
+        }
+        return ptr;
+    default:
+        return calloc(1, size);
+    }
+}
+
+static void __free(BENCH_MODE_E mode, void *ptr)
+{
+    if (BENCH_LIBC_CALLOC == mode) {
+        free(ptr);
+    } else {
+        tkl_system_free(ptr);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = argc > 1 ? strtoul(argv[1], NULL, 0) : 16 * 1024;
+    int num = argc > 2 ? atoi(argv[2]) : 256;
+    int rounds = argc > 3 ? atoi(argv[3]) : 200;
+    void **bufs = malloc(num * sizeof(void *));
+    heap_state_t state;
+    int mode, r, i;
+
+    if (NULL == bufs || 0 == size || num <= 0 || rounds <= 0) {
+        return 1;
+    }
+
+    printf("buffer %zu bytes, %d buffers per round, %d rounds\n", size, num, rounds);
+
+    for (mode = 0; mode < BENCH_MAX; mode++) {
+        double alloc_us = 0;
+        double round_us = 0;
+        double start = 0;
+
+        for (r = 0; r < rounds; r++) {
+            start = __now_us();
+            for (i = 0; i < num; i++) {
+                bufs[i] = __alloc(mode, size);
+                if (NULL == bufs[i]) {
+                    printf("%s: out of memory\n", s_mode_name[mode]);
+                    return 1;
+                }
+            }
+            alloc_us += __now_us() - start;
+
+            for (i = 0; i < num; i++) {
+                memset(bufs[i], 0x5a, size / 4);
+            }
+
+            for (i = 0; i < num; i++) {
+                __free(mode, bufs[i]);
+            }
+            round_us += __now_us() - start;
+        }
+
+        printf("%-18s alloc %8.3f us %10.1f MB/s, round %8.3f us per buffer\n", s_mode_name[mode],
+               alloc_us / ((double)rounds * num), (double)rounds * num * size / alloc_us,
+               round_us / ((double)rounds * num));
+    }
+
+    memset(&state, 0, sizeof(state));
+    tuya_mem_heap_state(0, &state);
+    printf("heap: total %lu, calloc skipped clearing %lu bytes\n", state.total_size, state.calloc_skip);
+
+    free(bufs);
+    return 0;
+}
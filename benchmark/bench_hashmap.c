@@ -0,0 +1,257 @@
+/**
+ * @file bench_hashmap.c
+ * @brief tuya_hashmap backends, put and lookup cost on DP code and topic key sets
+ * @version 0.1
+ * @date 2021-05-05
+ *
+ * @copyright Copyright 2021 Tuya Inc. All Rights Reserved.
+ *
+ * Key sets:
+ *   dp       DP codes like "switch_1", "bright_value_v2", short and sharing prefixes
+ *   topic    MQTT topics like "tylink/<device id>/thing/property/report", long
+ *            and differing only in the middle
+ *
+ * Backends:
+ *   chain    TUYA_HASHMAP_CHAIN, a list per bucket
+ *   open     TUYA_HASHMAP_OPEN, robin hood open addressing
+ *   arena    TUYA_HASHMAP_ARENA, open addressing with the keys copied into chunks
+ *
+ * Every run puts n keys into a map of the given table size, then gets every
+ * key r times in a shuffled order, then gets as many keys that are not in the
+ * map. One JSON object per backend, key set, key count and table size:
+ *   {"backend":..,"keyset":..,"keys":..,"table_size":..,"avg_keylen":..,"put_ns":..,
+ *    "get_hit_ns":..,"get_miss_ns":..,"found":..}
+ *
+ * usage: bench_hashmap [-k keyset,..] [-n keys,..] [-b table size] [-r rounds] [-m backend,..]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tuya_hashmap.h"
+
+#define BENCH_KEY_MAX       (96)
+
+typedef struct {
+    const char *name;
+    void (*make)(char *key, uint32_t idx, uint32_t salt);
+} BENCH_KEYSET_T;
+
+typedef struct {
+    const char *name;
+    TUYA_HASHMAP_TYPE_E type;
+} BENCH_BACKEND_T;
+
+static const BENCH_BACKEND_T s_backend[] = {
+    {"chain", TUYA_HASHMAP_CHAIN},
+    {"open",  TUYA_HASHMAP_OPEN},
+    {"arena", TUYA_HASHMAP_ARENA},
+};
+
+static const char *s_dp_code[] = {
+    "switch", "countdown", "bright_value_v2", "temp_value", "colour_data", "work_mode",
+    "scene_data", "cur_current", "cur_power", "cur_voltage", "add_ele", "relay_status",
+    "child_lock", "battery_percentage", "va_temperature", "va_humidity", "doorcontact_state",
+    "pir_state", "light_mode", "cycle_time",
+};
+
+static const char *s_topic_tail[] = {
+    "thing/property/report", "thing/property/set", "thing/event/trigger",
+    "thing/model/get", "device/sub/bind", "ota/issue",
+};
+
+static uint32_t s_rounds = 10;
+static uint32_t s_table_size = 64;
+
+static uint64_t __now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int __selected(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = list;
+
+    if (NULL == list) {
+        return 1;
+    }
+
+    while ((p = strstr(p, name)) != NULL) {
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) {
+            return 1;
+        }
+        p += len;
+    }
+
+    return 0;
+}
+
+/* salt tells the missing keys apart from the ones in the map */
+static void __make_dp(char *key, uint32_t idx, uint32_t salt)
+{
+    uint32_t num = sizeof(s_dp_code) / sizeof(s_dp_code[0]);
+
+    snprintf(key, BENCH_KEY_MAX, "%s_%u", s_dp_code[idx % num], idx / num * 2 + salt + 1);
+}
+
+static void __make_topic(char *key, uint32_t idx, uint32_t salt)
+{
+    uint32_t num = sizeof(s_topic_tail) / sizeof(s_topic_tail[0]);
+    uint32_t dev = idx / num;
+
+    // device ids are 20 hex digits, like the ones issued by the cloud
+    snprintf(key, BENCH_KEY_MAX, "tylink/6c%08x%02xa1b2%06x/%s",
+             dev * 2654435761u, salt, dev, s_topic_tail[idx % num]);
+}
+
+static const BENCH_KEYSET_T s_keyset[] = {
+    {"dp",    __make_dp},
+    {"topic", __make_topic},
+};
+
+static int __run(const BENCH_BACKEND_T *backend, const BENCH_KEYSET_T *set, uint32_t keys)
+{
+    char *hit = malloc((size_t)keys * BENCH_KEY_MAX);
+    char *miss = malloc((size_t)keys * BENCH_KEY_MAX);
+    uint32_t *order = malloc(keys * sizeof(uint32_t));
+    MAP_T map = tuya_hashmap_new_ext(s_table_size, backend->type);
+    uint64_t start = 0, put_ns = 0, hit_ns = 0, miss_ns = 0, keylen = 0, found = 0;
+    uint32_t i = 0, j = 0, tmp = 0;
+    ANY_T data = NULL;
+
+    if (NULL == hit || NULL == miss || NULL == order || NULL == map) {
+        free(hit);
+        free(miss);
+        free(order);
+        if (map) {
+            tuya_hashmap_free(map);
+        }
+        return -1;
+    }
+
+    srand(keys);
+    for (i = 0; i < keys; i++) {
+        set->make(&hit[(size_t)i * BENCH_KEY_MAX], i, 0);
+        set->make(&miss[(size_t)i * BENCH_KEY_MAX], i, 1);
+        keylen += strlen(&hit[(size_t)i * BENCH_KEY_MAX]);
+        order[i] = i;
+    }
+    for (i = keys - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    // the map keeps the key pointers, the key arrays outlive it
+    start = __now_ns();
+    for (i = 0; i < keys; i++) {
+        tuya_hashmap_put(map, &hit[(size_t)i * BENCH_KEY_MAX], (ANY_T)(uintptr_t)(i + 1));
+    }
+    put_ns = __now_ns() - start;
+
+    start = __now_ns();
+    for (j = 0; j < s_rounds; j++) {
+        for (i = 0; i < keys; i++) {
+            if (MAP_OK == tuya_hashmap_get(map, &hit[(size_t)order[i] * BENCH_KEY_MAX], &data) &&
+                (uintptr_t)data == order[i] + 1) {
+                found++;
+            }
+        }
+    }
+    hit_ns = __now_ns() - start;
+
+    start = __now_ns();
+    for (j = 0; j < s_rounds; j++) {
+        for (i = 0; i < keys; i++) {
+            if (MAP_OK == tuya_hashmap_get(map, &miss[(size_t)order[i] * BENCH_KEY_MAX], &data)) {
+                found++;
+            }
+        }
+    }
+    miss_ns = __now_ns() - start;
+
+    // found is keys * rounds when every lookup was right
+    printf("{\"backend\":\"%s\",\"keyset\":\"%s\",\"keys\":%u,\"table_size\":%u,\"avg_keylen\":%.1f,\"put_ns\":%.1f,"
+           "\"get_hit_ns\":%.1f,\"get_miss_ns\":%.1f,\"found\":%llu}\n",
+           backend->name, set->name, keys, s_table_size, (double)keylen / keys, (double)put_ns / keys,
+           (double)hit_ns / ((uint64_t)keys * s_rounds), (double)miss_ns / ((uint64_t)keys * s_rounds),
+           (unsigned long long)found);
+    fflush(stdout);
+
+    for (i = 0; i < keys; i++) {
+        tuya_hashmap_remove(map, &hit[(size_t)i * BENCH_KEY_MAX], NULL);
+    }
+    tuya_hashmap_free(map);
+    free(hit);
+    free(miss);
+    free(order);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *keysets = NULL;
+    const char *backends = NULL;
+    const char *counts = "64,1024,16384";
+    const char *p = NULL;
+    uint32_t keys = 0;
+    size_t k = 0, b = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "k:n:b:r:m:")) != -1) {
+        switch (opt) {
+        case 'k':
+            keysets = optarg;
+            break;
+        case 'n':
+            counts = optarg;
+            break;
+        case 'b':
+            s_table_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            s_rounds = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            backends = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-k keyset,..] [-n keys,..] [-b table size] [-r rounds] [-m backend,..]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (0 == s_table_size || 0 == s_rounds) {
+        return 1;
+    }
+
+    for (p = counts; p && *p; p = strchr(p, ',') ? strchr(p, ',') + 1 : NULL) {
+        keys = strtoul(p, NULL, 0);
+        if (0 == keys) {
+            continue;
+        }
+
+        for (b = 0; b < sizeof(s_backend) / sizeof(s_backend[0]); b++) {
+            for (k = 0; k < sizeof(s_keyset) / sizeof(s_keyset[0]); k++) {
+                if (!__selected(backends, s_backend[b].name) || !__selected(keysets, s_keyset[k].name)) {
+                    continue;
+                }
+                if (0 != __run(&s_backend[b], &s_keyset[k], keys)) {
+                    fprintf(stderr, "%s/%s/%u failed\n", s_backend[b].name, s_keyset[k].name, keys);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
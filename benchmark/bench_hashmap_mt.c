@@ -0,0 +1,254 @@
+/**
+ * @file bench_hashmap_mt.c
+ * @brief tuya_hashmap lookups from many threads, one external mutex against the concurrent backend
+ * @version 0.1
+ * @date 2021-05-05
+ *
+ * @copyright Copyright 2021 Tuya Inc. All Rights Reserved.
+ *
+ * Maps:
+ *   mutex        TUYA_HASHMAP_OPEN with one tkl_mutex around every call, what
+ *                callers sharing a map do without the concurrent backend
+ *   concurrent   TUYA_HASHMAP_CONCURRENT, no lock around the calls
+ *
+ * Every run fills a map with n topic keys, then T threads each do c calls on
+ * random keys, w percent of them remove and put a key again, the others get
+ * one. Keys map to their index + 1, a get returning other data counts in
+ * "bad". One JSON object per map and thread count, "scaling" is ops_per_sec
+ * over the one thread run of the same map:
+ *   {"map":..,"threads":..,"keys":..,"write_pct":..,"ops":..,"sec":..,
+ *    "ops_per_sec":..,"scaling":..,"bad":..}
+ *
+ * usage: bench_hashmap_mt [-t threads,..] [-n keys] [-c calls per thread] [-w write percent] [-m map,..]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tkl_mutex.h"
+#include "tuya_hashmap.h"
+
+#define BENCH_KEY_MAX       (64)
+
+typedef struct {
+    const char *name;
+    TUYA_HASHMAP_TYPE_E type;
+    int locked;
+} BENCH_MAP_T;
+
+typedef struct {
+    uint32_t seed;
+    uint64_t bad;
+} BENCH_ARG_T;
+
+static const BENCH_MAP_T s_map_type[] = {
+    {"mutex",      TUYA_HASHMAP_OPEN,       1},
+    {"concurrent", TUYA_HASHMAP_CONCURRENT, 0},
+};
+
+static MAP_T s_map = NULL;
+static TKL_MUTEX_HANDLE s_mutex = NULL;
+static int s_locked = 0;
+static char *s_keys = NULL;
+static uint32_t s_key_num = 4096;
+static uint64_t s_calls = 1000000;
+static uint32_t s_write_pct = 1;
+static pthread_barrier_t s_barrier;
+
+static uint64_t __now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int __selected(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = list;
+
+    if (NULL == list) {
+        return 1;
+    }
+
+    while ((p = strstr(p, name)) != NULL) {
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) {
+            return 1;
+        }
+        p += len;
+    }
+
+    return 0;
+}
+
+static inline char *__key(uint32_t idx)
+{
+    return &s_keys[(size_t)idx * BENCH_KEY_MAX];
+}
+
+static void *__worker(void *arg)
+{
+    BENCH_ARG_T *st = (BENCH_ARG_T *)arg;
+    uint32_t seed = st->seed;
+    uint32_t idx = 0;
+    uint64_t i = 0;
+    ANY_T data = NULL;
+
+    pthread_barrier_wait(&s_barrier);
+    for (i = 0; i < s_calls; i++) {
+        seed = seed * 1103515245u + 12345u;
+        idx = (seed >> 8) % s_key_num;
+
+        if (s_locked) {
+            tkl_mutex_lock(s_mutex);
+        }
+        if ((seed >> 24) % 100 < s_write_pct) {
+            // a key some other thread removes meanwhile is only put back by that one
+            if (MAP_OK == tuya_hashmap_remove(s_map, __key(idx), NULL)) {
+                tuya_hashmap_put(s_map, __key(idx), (ANY_T)(uintptr_t)(idx + 1));
+            }
+        } else if (MAP_OK == tuya_hashmap_get(s_map, __key(idx), &data) && (uintptr_t)data != idx + 1) {
+            st->bad++;
+        }
+        if (s_locked) {
+            tkl_mutex_unlock(s_mutex);
+        }
+    }
+
+    return NULL;
+}
+
+static double __run(const BENCH_MAP_T *type, int threads, double base)
+{
+    BENCH_ARG_T *args = calloc(threads, sizeof(BENCH_ARG_T));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    uint64_t start = 0, bad = 0;
+    double sec = 0, ops = 0;
+    uint32_t i = 0;
+
+    s_map = tuya_hashmap_new_ext(s_key_num, type->type);
+    s_locked = type->locked;
+    if (NULL == args || NULL == tids || NULL == s_map) {
+        free(args);
+        free(tids);
+        if (s_map) {
+            tuya_hashmap_free(s_map);
+        }
+        return -1;
+    }
+
+    for (i = 0; i < s_key_num; i++) {
+        tuya_hashmap_put(s_map, __key(i), (ANY_T)(uintptr_t)(i + 1));
+    }
+
+    pthread_barrier_init(&s_barrier, NULL, threads + 1);
+    for (i = 0; i < (uint32_t)threads; i++) {
+        args[i].seed = i * 2654435761u + 1;
+        pthread_create(&tids[i], NULL, __worker, &args[i]);
+    }
+
+    pthread_barrier_wait(&s_barrier);
+    start = __now_ns();
+    for (i = 0; i < (uint32_t)threads; i++) {
+        pthread_join(tids[i], NULL);
+        bad += args[i].bad;
+    }
+    sec = (__now_ns() - start) / 1e9;
+    ops = threads * s_calls / sec;
+
+    printf("{\"map\":\"%s\",\"threads\":%d,\"keys\":%u,\"write_pct\":%u,\"ops\":%llu,\"sec\":%.6f,"
+           "\"ops_per_sec\":%.0f,\"scaling\":%.2f,\"bad\":%llu}\n",
+           type->name, threads, s_key_num, s_write_pct, (unsigned long long)(threads * s_calls), sec,
+           ops, (base > 0) ? ops / base : 1.0, (unsigned long long)bad);
+    fflush(stdout);
+
+    for (i = 0; i < s_key_num; i++) {
+        while (MAP_OK == tuya_hashmap_remove(s_map, __key(i), NULL)) {
+        }
+    }
+    tuya_hashmap_free(s_map);
+    pthread_barrier_destroy(&s_barrier);
+    free(args);
+    free(tids);
+
+    return ops;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *threads = "1,2,4,8,16";
+    const char *maps = NULL;
+    const char *p = NULL;
+    double base = 0, ops = 0;
+    int thread_num = 0;
+    uint32_t i = 0;
+    size_t m = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "t:n:c:w:m:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = optarg;
+            break;
+        case 'n':
+            s_key_num = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            s_calls = strtoull(optarg, NULL, 0);
+            break;
+        case 'w':
+            s_write_pct = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            maps = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads,..] [-n keys] [-c calls per thread] [-w write percent] [-m map,..]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (0 == s_key_num || 0 == s_calls || s_write_pct > 100 || OPRT_OK != tkl_mutex_create_init(&s_mutex)) {
+        return 1;
+    }
+
+    // device topics, the map keeps the key pointers
+    s_keys = malloc((size_t)s_key_num * BENCH_KEY_MAX);
+    if (NULL == s_keys) {
+        return 1;
+    }
+    for (i = 0; i < s_key_num; i++) {
+        snprintf(__key(i), BENCH_KEY_MAX, "tylink/6c%08xa1b2%08x/thing/property/report", i * 2654435761u, i);
+    }
+
+    for (m = 0; m < sizeof(s_map_type) / sizeof(s_map_type[0]); m++) {
+        if (!__selected(maps, s_map_type[m].name)) {
+            continue;
+        }
+
+        base = 0;
+        for (p = threads; p && *p; p = strchr(p, ',') ? strchr(p, ',') + 1 : NULL) {
+            thread_num = atoi(p);
+            if (thread_num <= 0) {
+                continue;
+            }
+            ops = __run(&s_map_type[m], thread_num, base);
+            if (ops < 0) {
+                fprintf(stderr, "%s/%d failed\n", s_map_type[m].name, thread_num);
+            } else if (0 == base) {
+                base = ops;
+            }
+        }
+    }
+
+    tkl_mutex_release(s_mutex);
+    free(s_keys);
+
+    return 0;
+}
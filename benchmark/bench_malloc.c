@@ -0,0 +1,604 @@
+/**
+ * @file bench_malloc.c
+ * @brief allocator traces replayed on tkl_system_malloc, tuya_mem_heap and glibc
+ * @version 0.1
+ * @date 2021-05-05
+ *
+ * @copyright Copyright 2021 Tuya Inc. All Rights Reserved.
+ *
+ * Traces:
+ *   churn     small objects allocated and freed at random from a live set
+ *   prodcons  producer threads allocate, consumer threads free what they get
+ *   realloc   buffers grown step by step like string builders, then freed
+ *   frag      mixed sizes and lifetimes over a long run
+ *
+ * Every trace runs in a forked child per backend, so each backend starts from
+ * a fresh process and its peak RSS is its own. Every operation is timed, the
+ * timer overhead is in the latency of all backends alike. One JSON object is
+ * printed per trace and backend:
+ *   {"trace":..,"backend":..,"threads":..,"ops":..,"sec":..,"ops_per_sec":..,
+ *    "p50_ns":..,"p99_ns":..,"p999_ns":..,"peak_rss_kb":..,"peak_live_kb":..,"fail":..}
+ *
+ * usage: bench_malloc [-t threads] [-n ops per thread] [-b backend,..] [-r trace,..]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "tkl_memory.h"
+#include "tuya_mem_heap.h"
+
+#define BENCH_HEAP_SIZE     (512u * 1024 * 1024)   // fixed heap for the raw tuya_mem_heap backends
+#define BENCH_SLOT_NUM      (1024)                  // live objects per thread
+#define BENCH_RING_SIZE     (1024)                  // producer to consumer ring, power of two
+#define BENCH_LIVE_FLUSH    (256)                   // ops between updates of the shared live bytes
+#define BENCH_PAGE_SIZE     (4096)
+
+/* latency histogram, 16 linear buckets per power of two nanoseconds */
+#define HIST_SUB_LOG2       (4)
+#define HIST_SUB            (1 << HIST_SUB_LOG2)
+#define HIST_NUM            ((64 - HIST_SUB_LOG2) * HIST_SUB)
+
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+} BENCH_BACKEND_T;
+
+typedef struct {
+    uint64_t hist[HIST_NUM];
+    uint64_t ops;
+    uint64_t fail;
+    int64_t live;           // bytes not yet flushed to s_live
+    uint32_t flush;
+    uint32_t seed;
+} BENCH_THREAD_T;
+
+typedef struct {
+    void *ptr;
+    size_t size;
+} BENCH_OBJ_T;
+
+typedef struct {
+    BENCH_OBJ_T obj[BENCH_RING_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    int done;
+} BENCH_RING_T;
+
+typedef struct {
+    const char *name;
+    void *(*run)(void *arg);
+    int pairs;              // threads work in producer/consumer pairs
+} BENCH_TRACE_T;
+
+typedef struct {
+    BENCH_THREAD_T stat;
+    BENCH_RING_T *ring;
+    int index;
+} BENCH_ARG_T;
+
+static const BENCH_BACKEND_T *s_be = NULL;
+static HEAP_HANDLE s_heap = NULL;
+static uint64_t s_ops = 100000;
+static int64_t s_live = 0;
+static int64_t s_live_peak = 0;
+static pthread_barrier_t s_barrier;
+
+/*
+ * backends
+ */
+static void __tkl_init(void)
+{
+    // the first call sets up the system heap and the heap lock for all heaps
+    tkl_system_free(tkl_system_malloc(1));
+}
+
+static void __heap_init(HEAP_ALGO_E algo)
+{
+    void *buf = NULL;
+
+    __tkl_init();
+    buf = mmap(NULL, BENCH_HEAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == buf || 0 != tuya_mem_heap_create_ext(buf, BENCH_HEAP_SIZE, algo, &s_heap)) {
+        fprintf(stderr, "bench heap create failed\n");
+        exit(1);
+    }
+}
+
+static void __tlsf_init(void)
+{
+    __heap_init(HEAP_ALGO_TLSF);
+}
+
+static void __first_fit_init(void)
+{
+    __heap_init(HEAP_ALGO_FIRST_FIT);
+}
+
+static void *__heap_malloc(size_t size)
+{
+    return tuya_mem_heap_malloc(s_heap, size);
+}
+
+static void __heap_free(void *ptr)
+{
+    tuya_mem_heap_free(s_heap, ptr);
+}
+
+static void *__heap_realloc(void *ptr, size_t size)
+{
+    return tuya_mem_heap_realloc(s_heap, ptr, size);
+}
+
+static void __libc_init(void)
+{
+}
+
+static const BENCH_BACKEND_T s_backend[] = {
+    {"tkl",        __tkl_init,       tkl_system_malloc, tkl_system_free, tkl_system_realloc},
+    {"heap_tlsf",  __tlsf_init,      __heap_malloc,     __heap_free,     __heap_realloc},
+    {"heap_ff",    __first_fit_init, __heap_malloc,     __heap_free,     __heap_realloc},
+    {"libc",       __libc_init,      malloc,            free,            realloc},
+};
+
+/*
+ * measurement
+ */
+static uint64_t __now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int __hist_index(uint64_t ns)
+{
+    int msb = 0;
+
+    if (ns < HIST_SUB) {
+        return (int)ns;
+    }
+
+    msb = 63 - __builtin_clzll(ns);
+    return (msb - HIST_SUB_LOG2 + 1) * HIST_SUB + (int)((ns >> (msb - HIST_SUB_LOG2)) & (HIST_SUB - 1));
+}
+
+/* the lower edge of a bucket */
+static uint64_t __hist_value(int idx)
+{
+    int msb = idx / HIST_SUB + HIST_SUB_LOG2 - 1;
+
+    if (idx < HIST_SUB) {
+        return (uint64_t)idx;
+    }
+
+    return ((uint64_t)HIST_SUB | (idx & (HIST_SUB - 1))) << (msb - HIST_SUB_LOG2);
+}
+
+static uint64_t __hist_percentile(const uint64_t *hist, uint64_t total, double pct)
+{
+    uint64_t rank = (uint64_t)(total * pct);
+    uint64_t seen = 0;
+    int i = 0;
+
+    for (i = 0; i < HIST_NUM; i++) {
+        seen += hist[i];
+        if (seen > rank) {
+            return __hist_value(i);
+        }
+    }
+
+    return 0;
+}
+
+static void __live_add(BENCH_THREAD_T *st, int64_t bytes, int force)
+{
+    int64_t live = 0;
+    int64_t peak = 0;
+
+    st->live += bytes;
+    if (++st->flush < BENCH_LIVE_FLUSH && !force) {
+        return;
+    }
+
+    st->flush = 0;
+    live = __atomic_add_fetch(&s_live, st->live, __ATOMIC_RELAXED);
+    st->live = 0;
+    peak = __atomic_load_n(&s_live_peak, __ATOMIC_RELAXED);
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&s_live_peak, &peak, live, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static uint32_t __rand(BENCH_THREAD_T *st)
+{
+    st->seed ^= st->seed << 13;
+    st->seed ^= st->seed >> 17;
+    st->seed ^= st->seed << 5;
+    return st->seed;
+}
+
+/* write every page like a user of the block would */
+static void __touch(void *ptr, size_t size)
+{
+    size_t off = 0;
+
+    for (off = 0; off < size; off += BENCH_PAGE_SIZE) {
+        ((volatile uint8_t *)ptr)[off] = (uint8_t)off;
+    }
+    ((volatile uint8_t *)ptr)[size - 1] = 0;
+}
+
+static void *__op_malloc(BENCH_THREAD_T *st, size_t size)
+{
+    uint64_t start = __now_ns();
+    void *ptr = s_be->malloc(size);
+
+    st->hist[__hist_index(__now_ns() - start)]++;
+    st->ops++;
+    if (NULL == ptr) {
+        st->fail++;
+        return NULL;
+    }
+
+    __touch(ptr, size);
+    __live_add(st, (int64_t)size, 0);
+    return ptr;
+}
+
+static void __op_free(BENCH_THREAD_T *st, void *ptr, size_t size)
+{
+    uint64_t start = __now_ns();
+
+    s_be->free(ptr);
+    st->hist[__hist_index(__now_ns() - start)]++;
+    st->ops++;
+    __live_add(st, -(int64_t)size, 0);
+}
+
+static void *__op_realloc(BENCH_THREAD_T *st, void *ptr, size_t old_size, size_t size)
+{
+    uint64_t start = __now_ns();
+    void *tmp = s_be->realloc(ptr, size);
+
+    st->hist[__hist_index(__now_ns() - start)]++;
+    st->ops++;
+    if (NULL == tmp) {
+        st->fail++;
+        return NULL;
+    }
+
+    __touch(tmp, size);
+    __live_add(st, (int64_t)size - (int64_t)old_size, 0);
+    return tmp;
+}
+
+/*
+ * traces
+ */
+
+/* mostly 16 - 256 bytes, now and then up to 1KB */
+static size_t __small_size(BENCH_THREAD_T *st)
+{
+    uint32_t r = __rand(st);
+
+    return (r & 0xF) ? 16 + (r >> 8) % 241 : 256 + (r >> 8) % 769;
+}
+
+static void *__trace_churn(void *arg)
+{
+    BENCH_ARG_T *ba = (BENCH_ARG_T *)arg;
+    BENCH_THREAD_T *st = &ba->stat;
+    BENCH_OBJ_T *slot = calloc(BENCH_SLOT_NUM, sizeof(BENCH_OBJ_T));
+    uint32_t i = 0;
+
+    pthread_barrier_wait(&s_barrier);
+    while (st->ops < s_ops) {
+        i = __rand(st) % BENCH_SLOT_NUM;
+        if (slot[i].ptr) {
+            __op_free(st, slot[i].ptr, slot[i].size);
+            slot[i].ptr = NULL;
+        } else {
+            slot[i].size = __small_size(st);
+            slot[i].ptr = __op_malloc(st, slot[i].size);
+        }
+    }
+
+    for (i = 0; i < BENCH_SLOT_NUM; i++) {
+        if (slot[i].ptr) {
+            s_be->free(slot[i].ptr);
+        }
+    }
+    free(slot);
+    return NULL;
+}
+
+static void *__trace_prodcons(void *arg)
+{
+    BENCH_ARG_T *ba = (BENCH_ARG_T *)arg;
+    BENCH_THREAD_T *st = &ba->stat;
+    BENCH_RING_T *ring = ba->ring;
+    BENCH_OBJ_T obj;
+    uint32_t head = 0, tail = 0;
+
+    pthread_barrier_wait(&s_barrier);
+    if (0 == (ba->index & 1)) {
+        // producer
+        while (st->ops < s_ops) {
+            obj.size = __small_size(st);
+            obj.ptr = __op_malloc(st, obj.size);
+            if (NULL == obj.ptr) {
+                continue;
+            }
+            head = ring->head;
+            while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == BENCH_RING_SIZE) {
+                sched_yield();
+            }
+            ring->obj[head & (BENCH_RING_SIZE - 1)] = obj;
+            __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&ring->done, TRUE, __ATOMIC_RELEASE);
+    } else {
+        // consumer
+        for (;;) {
+            tail = ring->tail;
+            if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+                if (__atomic_load_n(&ring->done, __ATOMIC_ACQUIRE) &&
+                    tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+                    break;
+                }
+                sched_yield();
+                continue;
+            }
+            obj = ring->obj[tail & (BENCH_RING_SIZE - 1)];
+            __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+            __op_free(st, obj.ptr, obj.size);
+        }
+    }
+
+    return NULL;
+}
+
+static void *__trace_realloc(void *arg)
+{
+    BENCH_ARG_T *ba = (BENCH_ARG_T *)arg;
+    BENCH_THREAD_T *st = &ba->stat;
+    BENCH_OBJ_T buf[16] = {{0}};
+    size_t size = 0;
+    void *tmp = NULL;
+    uint32_t i = 0;
+
+    pthread_barrier_wait(&s_barrier);
+    while (st->ops < s_ops) {
+        i = __rand(st) & 15;
+        if (NULL == buf[i].ptr) {
+            buf[i].size = 16;
+            buf[i].ptr = __op_malloc(st, buf[i].size);
+        } else if (buf[i].size >= 64 * 1024) {
+            __op_free(st, buf[i].ptr, buf[i].size);
+            buf[i].ptr = NULL;
+        } else {
+            // grow by half and a bit, as a builder appending records does
+            size = buf[i].size + buf[i].size / 2 + __rand(st) % 64;
+            tmp = __op_realloc(st, buf[i].ptr, buf[i].size, size);
+            if (tmp) {
+                buf[i].ptr = tmp;
+                buf[i].size = size;
+            }
+        }
+    }
+
+    for (i = 0; i < 16; i++) {
+        if (buf[i].ptr) {
+            s_be->free(buf[i].ptr);
+        }
+    }
+    return NULL;
+}
+
+/* a tenth of the objects live long, sizes spread from 16 bytes to 16KB */
+static void *__trace_frag(void *arg)
+{
+    BENCH_ARG_T *ba = (BENCH_ARG_T *)arg;
+    BENCH_THREAD_T *st = &ba->stat;
+    BENCH_OBJ_T *slot = calloc(BENCH_SLOT_NUM * 4, sizeof(BENCH_OBJ_T));
+    uint32_t r = 0, i = 0;
+
+    pthread_barrier_wait(&s_barrier);
+    while (st->ops < s_ops) {
+        r = __rand(st);
+        i = r % (BENCH_SLOT_NUM * 4);
+        if (slot[i].ptr) {
+            // long lived objects are freed rarely
+            if (i % 10 == 0 && (r >> 24) != 0) {
+                continue;
+            }
+            __op_free(st, slot[i].ptr, slot[i].size);
+            slot[i].ptr = NULL;
+        } else {
+            slot[i].size = (size_t)16 << ((r >> 12) % 11);
+            slot[i].size += (r >> 16) % slot[i].size;
+            slot[i].ptr = __op_malloc(st, slot[i].size);
+        }
+    }
+
+    for (i = 0; i < BENCH_SLOT_NUM * 4; i++) {
+        if (slot[i].ptr) {
+            s_be->free(slot[i].ptr);
+        }
+    }
+    free(slot);
+    return NULL;
+}
+
+static const BENCH_TRACE_T s_trace[] = {
+    {"churn",    __trace_churn,    0},
+    {"prodcons", __trace_prodcons, 1},
+    {"realloc",  __trace_realloc,  0},
+    {"frag",     __trace_frag,     0},
+};
+
+/*
+ * driver
+ */
+static int __selected(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = list;
+
+    if (NULL == list) {
+        return 1;
+    }
+
+    while ((p = strstr(p, name)) != NULL) {
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) {
+            return 1;
+        }
+        p += len;
+    }
+
+    return 0;
+}
+
+/* runs in the child, writes one result line to fd */
+static void __run(const BENCH_TRACE_T *trace, int threads, int fd)
+{
+    BENCH_ARG_T *args = calloc(threads, sizeof(BENCH_ARG_T));
+    BENCH_RING_T *rings = calloc(threads / 2 + 1, sizeof(BENCH_RING_T));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    uint64_t *hist = calloc(HIST_NUM, sizeof(uint64_t));
+    uint64_t ops = 0, fail = 0, start = 0;
+    double sec = 0;
+    char line[512];
+    int i = 0, j = 0, len = 0;
+
+    s_be->init();
+    pthread_barrier_init(&s_barrier, NULL, threads + 1);
+
+    for (i = 0; i < threads; i++) {
+        args[i].index = i;
+        args[i].ring = &rings[i / 2];
+        args[i].stat.seed = 0x9E3779B9u * (i + 1);
+        pthread_create(&tids[i], NULL, trace->run, &args[i]);
+    }
+
+    pthread_barrier_wait(&s_barrier);
+    start = __now_ns();
+    for (i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    sec = (__now_ns() - start) / 1e9;
+
+    for (i = 0; i < threads; i++) {
+        __live_add(&args[i].stat, 0, 1);
+        ops += args[i].stat.ops;
+        fail += args[i].stat.fail;
+        for (j = 0; j < HIST_NUM; j++) {
+            hist[j] += args[i].stat.hist[j];
+        }
+    }
+
+    len = snprintf(line, sizeof(line),
+                   "{\"trace\":\"%s\",\"backend\":\"%s\",\"threads\":%d,\"ops\":%llu,\"sec\":%.6f,"
+                   "\"ops_per_sec\":%.0f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,"
+                   "\"peak_live_kb\":%lld,\"fail\":%llu",
+                   trace->name, s_be->name, threads, (unsigned long long)ops, sec, ops / sec,
+                   (unsigned long long)__hist_percentile(hist, ops, 0.50),
+                   (unsigned long long)__hist_percentile(hist, ops, 0.99),
+                   (unsigned long long)__hist_percentile(hist, ops, 0.999),
+                   (long long)(s_live_peak / 1024), (unsigned long long)fail);
+    if (write(fd, line, len) != len) {
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *backends = NULL;
+    const char *traces = NULL;
+    struct rusage usage;
+    char line[512];
+    int threads = 4;
+    int status = 0;
+    int fds[2];
+    size_t t = 0, b = 0;
+    ssize_t len = 0;
+    pid_t pid;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "t:n:b:r:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            s_ops = strtoull(optarg, NULL, 0);
+            break;
+        case 'b':
+            backends = optarg;
+            break;
+        case 'r':
+            traces = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-n ops per thread] [-b backend,..] [-r trace,..]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (threads <= 0 || 0 == s_ops) {
+        return 1;
+    }
+
+    for (t = 0; t < sizeof(s_trace) / sizeof(s_trace[0]); t++) {
+        if (!__selected(traces, s_trace[t].name)) {
+            continue;
+        }
+
+        for (b = 0; b < sizeof(s_backend) / sizeof(s_backend[0]); b++) {
+            if (!__selected(backends, s_backend[b].name)) {
+                continue;
+            }
+
+            if (0 != pipe(fds)) {
+                return 1;
+            }
+
+            pid = fork();
+            if (0 == pid) {
+                close(fds[0]);
+                s_be = &s_backend[b];
+                // a producer needs its consumer
+                __run(&s_trace[t], s_trace[t].pairs ? (threads < 2 ? 2 : threads & ~1) : threads, fds[1]);
+                _exit(0);
+            }
+
+            close(fds[1]);
+            len = read(fds[0], line, sizeof(line) - 1);
+            close(fds[0]);
+            if (pid < 0 || wait4(pid, &status, 0, &usage) < 0 || len <= 0 || !WIFEXITED(status)) {
+                fprintf(stderr, "%s/%s failed\n", s_trace[t].name, s_backend[b].name);
+                continue;
+            }
+
+            line[len] = '\0';
+            printf("%s,\"peak_rss_kb\":%ld}\n", line, usage.ru_maxrss);
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
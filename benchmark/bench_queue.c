@@ -0,0 +1,254 @@
+/**
+ * @file bench_queue.c
+ * @brief tkl_queue modes compared across producer and consumer thread counts
+ * @version 0.1
+ * @date 2021-05-05
+ *
+ * @copyright Copyright 2021 Tuya Inc. All Rights Reserved.
+ *
+ * Modes:
+ *   rpa      the default queue, a heap copy per message under one mutex
+ *   inline   TKL_QUEUE_FLAG_INLINE, slots under one mutex
+ *   mpmc     TKL_QUEUE_FLAG_MPMC, lock-free sequence ring
+ *   spsc     TKL_QUEUE_FLAG_SPSC, lock-free ring, only run with 1 producer and 1 consumer
+ *
+ * Every run starts P producers and P consumers, producers post n messages
+ * each with TKL_QUEUE_WAIT_FROEVER, consumers fetch until they get a stop
+ * message posted after all producers are done. A post or fetch that returns
+ * an error is retried and counted in "retry". One JSON object per run:
+ *   {"mode":..,"producers":..,"consumers":..,"msgs":..,"msgsize":..,"capacity":..,
+ *    "sec":..,"msgs_per_sec":..,"retry":..,"lost":..,"sum_ok":..}
+ *
+ * usage: bench_queue [-t threads,..] [-n msgs per producer] [-s msgsize] [-c capacity] [-m mode,..]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tkl_queue.h"
+
+#define BENCH_MSG_MAX       (1024)
+#define BENCH_STOP          (0xFFFFFFFFu)   // seq of the message ending a consumer
+
+typedef struct {
+    const char *name;
+    uint32_t flags;
+    int spsc;
+} BENCH_MODE_T;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t producer;
+} BENCH_MSG_HEAD_T;
+
+typedef struct {
+    uint32_t index;
+    uint64_t retry;
+    uint64_t got;
+    uint64_t sum;
+} BENCH_ARG_T;
+
+static const BENCH_MODE_T s_mode[] = {
+    {"rpa",    0,                     0},
+    {"inline", TKL_QUEUE_FLAG_INLINE, 0},
+    {"mpmc",   TKL_QUEUE_FLAG_MPMC,   0},
+    {"spsc",   TKL_QUEUE_FLAG_SPSC,   1},
+};
+
+static TKL_QUEUE_HANDLE s_queue = NULL;
+static uint64_t s_msgs = 1000000;
+static int s_msgsize = 32;
+static int s_capacity = 1024;
+static pthread_barrier_t s_barrier;
+
+static uint64_t __now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int __selected(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = list;
+
+    if (NULL == list) {
+        return 1;
+    }
+
+    while ((p = strstr(p, name)) != NULL) {
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) {
+            return 1;
+        }
+        p += len;
+    }
+
+    return 0;
+}
+
+static void *__producer(void *arg)
+{
+    BENCH_ARG_T *st = (BENCH_ARG_T *)arg;
+    uint8_t msg[BENCH_MSG_MAX];
+    BENCH_MSG_HEAD_T *head = (BENCH_MSG_HEAD_T *)msg;
+    uint64_t i = 0;
+
+    memset(msg, 0, sizeof(msg));
+    head->producer = st->index;
+
+    pthread_barrier_wait(&s_barrier);
+    for (i = 0; i < s_msgs; i++) {
+        head->seq = (uint32_t)i;
+        while (OPRT_OK != tkl_queue_post(s_queue, msg, TKL_QUEUE_WAIT_FROEVER)) {
+            st->retry++;
+        }
+    }
+
+    return NULL;
+}
+
+static void *__consumer(void *arg)
+{
+    BENCH_ARG_T *st = (BENCH_ARG_T *)arg;
+    uint8_t msg[BENCH_MSG_MAX];
+    BENCH_MSG_HEAD_T *head = (BENCH_MSG_HEAD_T *)msg;
+
+    pthread_barrier_wait(&s_barrier);
+    for (;;) {
+        if (OPRT_OK != tkl_queue_fetch(s_queue, msg, TKL_QUEUE_WAIT_FROEVER)) {
+            st->retry++;
+            continue;
+        }
+        if (BENCH_STOP == head->seq) {
+            break;
+        }
+        st->got++;
+        st->sum += head->seq;
+    }
+
+    return NULL;
+}
+
+static int __run(const BENCH_MODE_T *mode, int threads)
+{
+    BENCH_ARG_T *args = calloc(threads * 2, sizeof(BENCH_ARG_T));
+    pthread_t *tids = calloc(threads * 2, sizeof(pthread_t));
+    uint8_t msg[BENCH_MSG_MAX];
+    uint64_t start = 0, retry = 0, got = 0, sum = 0;
+    double sec = 0;
+    int i = 0;
+
+    if (NULL == args || NULL == tids ||
+        OPRT_OK != tkl_queue_create_init_ext(&s_queue, s_msgsize, s_capacity, mode->flags)) {
+        free(args);
+        free(tids);
+        return -1;
+    }
+
+    pthread_barrier_init(&s_barrier, NULL, threads * 2 + 1);
+    for (i = 0; i < threads * 2; i++) {
+        args[i].index = i;
+        pthread_create(&tids[i], NULL, (i < threads) ? __producer : __consumer, &args[i]);
+    }
+
+    pthread_barrier_wait(&s_barrier);
+    start = __now_ns();
+    for (i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    memset(msg, 0, sizeof(msg));
+    ((BENCH_MSG_HEAD_T *)msg)->seq = BENCH_STOP;
+    for (i = 0; i < threads; i++) {
+        while (OPRT_OK != tkl_queue_post(s_queue, msg, TKL_QUEUE_WAIT_FROEVER)) {
+        }
+    }
+    for (i = threads; i < threads * 2; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    sec = (__now_ns() - start) / 1e9;
+
+    for (i = 0; i < threads * 2; i++) {
+        retry += args[i].retry;
+        got += args[i].got;
+        sum += args[i].sum;
+    }
+
+    // every producer posts 0 .. msgs - 1, a lost or doubled message shows in the sum
+    printf("{\"mode\":\"%s\",\"producers\":%d,\"consumers\":%d,\"msgs\":%llu,\"msgsize\":%d,\"capacity\":%d,"
+           "\"sec\":%.6f,\"msgs_per_sec\":%.0f,\"retry\":%llu,\"lost\":%lld,\"sum_ok\":%d}\n",
+           mode->name, threads, threads, (unsigned long long)got, s_msgsize, s_capacity,
+           sec, got / sec, (unsigned long long)retry,
+           (long long)(threads * s_msgs - got), sum == threads * (s_msgs * (s_msgs - 1) / 2));
+    fflush(stdout);
+
+    tkl_queue_free(s_queue);
+    pthread_barrier_destroy(&s_barrier);
+    free(args);
+    free(tids);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *threads = "1,2,4,8,16";
+    const char *modes = NULL;
+    const char *p = NULL;
+    int thread_num = 0;
+    size_t m = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "t:n:s:c:m:")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = optarg;
+            break;
+        case 'n':
+            s_msgs = strtoull(optarg, NULL, 0);
+            break;
+        case 's':
+            s_msgsize = atoi(optarg);
+            break;
+        case 'c':
+            s_capacity = atoi(optarg);
+            break;
+        case 'm':
+            modes = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads,..] [-n msgs per producer] [-s msgsize] [-c capacity] [-m mode,..]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (0 == s_msgs || s_msgs >= BENCH_STOP || s_capacity <= 0 ||
+        s_msgsize < (int)sizeof(BENCH_MSG_HEAD_T) || s_msgsize > BENCH_MSG_MAX) {
+        return 1;
+    }
+
+    for (p = threads; p && *p; p = strchr(p, ',') ? strchr(p, ',') + 1 : NULL) {
+        thread_num = atoi(p);
+        if (thread_num <= 0) {
+            continue;
+        }
+
+        for (m = 0; m < sizeof(s_mode) / sizeof(s_mode[0]); m++) {
+            if (!__selected(modes, s_mode[m].name) || (s_mode[m].spsc && 1 != thread_num)) {
+                continue;
+            }
+            if (0 != __run(&s_mode[m], thread_num)) {
+                fprintf(stderr, "%s/%d failed\n", s_mode[m].name, thread_num);
+            }
+        }
+    }
+
+    return 0;
+}
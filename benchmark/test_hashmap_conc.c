@@ -0,0 +1,221 @@
+/**
+ * @file test_hashmap_conc.c
+ * @brief TUYA_HASHMAP_CONCURRENT with several writers on tables of few buckets
+ * @version 0.1
+ * @date 2021-05-05
+ *
+ * @copyright Copyright 2021 Tuya Inc. All Rights Reserved.
+ *
+ * A table with fewer buckets than HASHMAP_LOCK_STRIPES puts many hashes in
+ * one bucket, every writer on it must still take the same lock. For each
+ * table size T writer threads remove and put again keys of their own while
+ * one reader gets and traverses them. Keys map to their index + 1, a get or
+ * traversal returning other data counts in "bad", a key missing or doubled
+ * at the end in "lost". One JSON object per table size, exit status 1 if any
+ * run went wrong:
+ *   {"table_size":..,"writers":..,"keys":..,"ops":..,"bad":..,"lost":..}
+ *
+ * usage: test_hashmap_conc [-b table size,..] [-t writers] [-n keys] [-c calls per writer]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tuya_hashmap.h"
+
+#define TEST_KEY_MAX        (64)
+
+typedef struct {
+    uint32_t index;
+    uint32_t seed;
+    uint64_t bad;
+} TEST_ARG_T;
+
+static MAP_T s_map = NULL;
+static char *s_keys = NULL;
+static uint32_t s_key_num = 256;
+static uint32_t s_writers = 4;
+static uint64_t s_calls = 200000;
+static volatile int s_stop = 0;
+static pthread_barrier_t s_barrier;
+
+static inline char *__key(uint32_t idx)
+{
+    return &s_keys[(size_t)idx * TEST_KEY_MAX];
+}
+
+/* writer i owns the keys idx % writers == i, so a removed key is only put back by it */
+static void *__writer(void *arg)
+{
+    TEST_ARG_T *st = (TEST_ARG_T *)arg;
+    uint32_t seed = st->seed;
+    uint32_t idx = 0;
+    uint64_t i = 0;
+
+    pthread_barrier_wait(&s_barrier);
+    for (i = 0; i < s_calls; i++) {
+        seed = seed * 1103515245u + 12345u;
+        idx = ((seed >> 8) % (s_key_num / s_writers)) * s_writers + st->index;
+        if (MAP_OK != tuya_hashmap_remove(s_map, __key(idx), NULL) ||
+            MAP_OK != tuya_hashmap_put(s_map, __key(idx), (ANY_T)(uintptr_t)(idx + 1))) {
+            st->bad++;
+        }
+    }
+
+    return NULL;
+}
+
+static void *__reader(void *arg)
+{
+    TEST_ARG_T *st = (TEST_ARG_T *)arg;
+    uint32_t seed = st->seed;
+    uint32_t idx = 0;
+    uint32_t token = 0;
+    ANY_T data = NULL;
+    ANY_T *iter = NULL;
+
+    pthread_barrier_wait(&s_barrier);
+    while (!__atomic_load_n(&s_stop, __ATOMIC_RELAXED)) {
+        seed = seed * 1103515245u + 12345u;
+        idx = (seed >> 8) % s_key_num;
+        if (MAP_OK == tuya_hashmap_get(s_map, __key(idx), &data) && (uintptr_t)data != idx + 1) {
+            st->bad++;
+        }
+
+        token = tuya_hashmap_read_lock(s_map);
+        TUYA_HASHMAP_FOR_EACH_DATA(s_map, __key(idx), iter) {
+            if ((uintptr_t)*iter != idx + 1) {
+                st->bad++;
+            }
+        }
+        tuya_hashmap_read_unlock(s_map, token);
+    }
+
+    return NULL;
+}
+
+static int __run(uint32_t table_size)
+{
+    TEST_ARG_T *args = calloc(s_writers + 1, sizeof(TEST_ARG_T));
+    pthread_t *tids = calloc(s_writers + 1, sizeof(pthread_t));
+    uint64_t bad = 0, lost = 0;
+    ANY_T data = NULL;
+    uint32_t i = 0;
+
+    s_map = tuya_hashmap_new_ext(table_size, TUYA_HASHMAP_CONCURRENT);
+    if (NULL == args || NULL == tids || NULL == s_map) {
+        free(args);
+        free(tids);
+        if (s_map) {
+            tuya_hashmap_free(s_map);
+        }
+        return -1;
+    }
+
+    for (i = 0; i < s_key_num; i++) {
+        tuya_hashmap_put(s_map, __key(i), (ANY_T)(uintptr_t)(i + 1));
+    }
+
+    s_stop = 0;
+    pthread_barrier_init(&s_barrier, NULL, s_writers + 1);
+    for (i = 0; i <= s_writers; i++) {
+        args[i].index = i;
+        args[i].seed = i * 2654435761u + 1;
+        pthread_create(&tids[i], NULL, (i < s_writers) ? __writer : __reader, &args[i]);
+    }
+    for (i = 0; i < s_writers; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    __atomic_store_n(&s_stop, 1, __ATOMIC_RELAXED);
+    pthread_join(tids[s_writers], NULL);
+
+    for (i = 0; i <= s_writers; i++) {
+        bad += args[i].bad;
+    }
+
+    // every key is in the map exactly once
+    for (i = 0; i < s_key_num; i++) {
+        if (MAP_OK != tuya_hashmap_get(s_map, __key(i), &data) || (uintptr_t)data != i + 1 ||
+            MAP_OK != tuya_hashmap_remove(s_map, __key(i), NULL) ||
+            MAP_OK == tuya_hashmap_get(s_map, __key(i), &data)) {
+            lost++;
+        }
+    }
+    if (0 != tuya_hashmap_length(s_map)) {
+        lost++;
+    }
+
+    printf("{\"table_size\":%u,\"writers\":%u,\"keys\":%u,\"ops\":%llu,\"bad\":%llu,\"lost\":%llu}\n",
+           table_size, s_writers, s_key_num, (unsigned long long)(s_writers * s_calls),
+           (unsigned long long)bad, (unsigned long long)lost);
+    fflush(stdout);
+
+    tuya_hashmap_free(s_map);
+    pthread_barrier_destroy(&s_barrier);
+    free(args);
+    free(tids);
+
+    return (0 == bad && 0 == lost) ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *sizes = "1,2,4,8,64";
+    const char *p = NULL;
+    int table_size = 0;
+    int ret = 0;
+    uint32_t i = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "b:t:n:c:")) != -1) {
+        switch (opt) {
+        case 'b':
+            sizes = optarg;
+            break;
+        case 't':
+            s_writers = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            s_key_num = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            s_calls = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b table size,..] [-t writers] [-n keys] [-c calls per writer]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (0 == s_writers || s_key_num < s_writers || 0 == s_calls) {
+        return 1;
+    }
+
+    // the map keeps the key pointers
+    s_keys = malloc((size_t)s_key_num * TEST_KEY_MAX);
+    if (NULL == s_keys) {
+        return 1;
+    }
+    for (i = 0; i < s_key_num; i++) {
+        snprintf(__key(i), TEST_KEY_MAX, "tylink/6c%08xa1b2%08x/thing/property/report", i * 2654435761u, i);
+    }
+
+    for (p = sizes; p && *p; p = strchr(p, ',') ? strchr(p, ',') + 1 : NULL) {
+        table_size = atoi(p);
+        if (table_size <= 0) {
+            continue;
+        }
+        if (0 != __run(table_size)) {
+            fprintf(stderr, "table size %d failed\n", table_size);
+            ret = 1;
+        }
+    }
+
+    free(s_keys);
+
+    return ret;
+}
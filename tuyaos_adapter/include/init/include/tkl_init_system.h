@@ -87,6 +87,9 @@ typedef struct {
     void              (*queue_free)               (const TKL_QUEUE_HANDLE queue);
     OPERATE_RET         (*queue_post)               (const TKL_QUEUE_HANDLE queue, void *data, const uint32_t timeout);
     OPERATE_RET         (*queue_fetch)              (const TKL_QUEUE_HANDLE queue, void *msg, const uint32_t timeout);
+    //! memory, appended to keep the layout above for prebuilt users
+    void*             (*malloc_aligned)           (const size_t size, const size_t align);
+    void              (*free_aligned)             (void* ptr);
 } TKL_OS_T;
 
 /**
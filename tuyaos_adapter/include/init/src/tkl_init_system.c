@@ -59,6 +59,9 @@ const TKL_OS_T TKL_OS  = {
     .queue_free             = tkl_queue_free,
     .queue_post             = tkl_queue_post,
     .queue_fetch            = tkl_queue_fetch,
+    //! memory
+    .malloc_aligned         = tkl_system_malloc_aligned,
+    .free_aligned           = tkl_system_free_aligned,
 };
 
 const TKL_FS_T TKL_FS = {
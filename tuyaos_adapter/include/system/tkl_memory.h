@@ -58,6 +58,29 @@ void *tkl_system_calloc(size_t nitems, size_t size);
  */
 void *tkl_system_realloc(void* ptr, size_t size);
 
+/**
+* @brief Alloc memory of system with the given alignment
+*
+* @param[in] size: memory size
+* @param[in] align: alignment of the memory address, a power of two
+*
+* @note The block is cut out of the heap at the alignment, it must be freed by
+*       tkl_system_free_aligned and not be passed to tkl_system_free or
+*       tkl_system_realloc.
+*
+* @return the memory address malloced, NULL on error
+*/
+void *tkl_system_malloc_aligned(SIZE_T size, SIZE_T align);
+
+/**
+* @brief Free memory alloced by tkl_system_malloc_aligned
+*
+* @param[in] ptr: memory point
+*
+* @return void
+*/
+void tkl_system_free_aligned(void* ptr);
+
 /**
 * @brief Get system free heap size
 *
@@ -19,6 +19,40 @@ extern "C" {
 #define TKL_QUEUE_WAIT_FROEVER 0xFFFFFFFF
 typedef void* TKL_QUEUE_HANDLE;
 
+/* flags of tkl_queue_create_init_ext */
+#define TKL_QUEUE_FLAG_INLINE   (1 << 0)    // msgcount * msgsize slots allocated at create, post and fetch do not touch the heap
+#define TKL_QUEUE_FLAG_MPMC     (1 << 1)    // lock-free ring for any number of producers and consumers, inline, msgcount rounded up to a power of two
+#define TKL_QUEUE_FLAG_SPSC     (1 << 2)    // lock-free ring for one producer and one consumer thread, inline, msgcount rounded up to a power of two
+#define TKL_QUEUE_FLAG_STATS    (1 << 3)    // keep statistics, see tkl_queue_stat_get and tkl_queue_stat_foreach
+#define TKL_QUEUE_FLAG_AGING    (1 << 4)    // with TKL_QUEUE_FLAG_PRIO, a message passed over by many fetches is fetched next
+#define TKL_QUEUE_FLAG_PRIO(levels) (((uint32_t)(levels) & 0xFF) << 8) // levels 2..255 fetched highest first, post by tkl_queue_post_prio, not with MPMC or SPSC
+#define TKL_QUEUE_PRIO_LEVELS(flags) (((flags) >> 8) & 0xFF)
+
+#define TKL_QUEUE_NAME_MAX      16
+#define TKL_QUEUE_WAIT_HIST_NUM 16          // wait histogram buckets, see TKL_QUEUE_STAT_T
+
+/**
+ * @brief the statistics of a queue created with TKL_QUEUE_FLAG_STATS
+ *
+ * @note wait_hist[0] counts waits under 1us, wait_hist[i] waits of [2^(i-1), 2^i) us,
+ *       the last bucket everything longer. Only posts and fetches that had to
+ *       wait for the queue are put in the histograms, timed out ones included
+ */
+typedef struct {
+    char name[TKL_QUEUE_NAME_MAX];      ///< set by tkl_queue_set_name, "" if not set
+    uint32_t capacity;
+    uint32_t depth;                     ///< messages queued now
+    uint32_t peak_depth;                ///< highest depth seen
+    uint64_t post_cnt;                  ///< messages posted
+    uint64_t fetch_cnt;                 ///< messages fetched
+    uint64_t full_cnt;                  ///< posts that found the queue full and waited
+    uint64_t empty_cnt;                 ///< fetches that found the queue empty and waited
+    uint32_t post_wait_hist[TKL_QUEUE_WAIT_HIST_NUM];
+    uint32_t fetch_wait_hist[TKL_QUEUE_WAIT_HIST_NUM];
+} TKL_QUEUE_STAT_T;
+
+typedef void (*TKL_QUEUE_STAT_CB)(const TKL_QUEUE_STAT_T *stat, void *arg);
+
 
 
 /**
@@ -32,6 +66,18 @@ typedef void* TKL_QUEUE_HANDLE;
  */
 OPERATE_RET tkl_queue_create_init(TKL_QUEUE_HANDLE *queue, int msgsize, int msgcount);
 
+/**
+ * @brief Create message queue with the given mode
+ *
+ * @param[out] queue the queue handle created
+ * @param[in] msgsize message size
+ * @param[in] msgcount message number
+ * @param[in] flags TKL_QUEUE_FLAG_XXX, 0 is the same as tkl_queue_create_init
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tkl_queue_create_init_ext(TKL_QUEUE_HANDLE *queue, int msgsize, int msgcount, uint32_t flags);
+
 /**
  * @brief post a message to the message queue
  *
@@ -43,6 +89,21 @@ OPERATE_RET tkl_queue_create_init(TKL_QUEUE_HANDLE *queue, int msgsize, int msgc
  */
 OPERATE_RET tkl_queue_post(const TKL_QUEUE_HANDLE queue, void *data, uint32_t timeout);
 
+/**
+ * @brief post a message to the message queue at a priority level
+ *
+ * @param[in] queue the handle of the queue
+ * @param[in] data the data of the message
+ * @param[in] prio the level, the highest level is fetched first, above it is taken as the highest
+ * @param[in] timeout timeout time
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note a queue without TKL_QUEUE_FLAG_PRIO ignores prio, tkl_queue_post and
+ *       tkl_queue_post_batch post at level 0, the lowest
+ */
+OPERATE_RET tkl_queue_post_prio(const TKL_QUEUE_HANDLE queue, void *data, uint32_t prio, uint32_t timeout);
+
 /**
  * @brief fetch message from the message queue
  *
@@ -54,6 +115,117 @@ OPERATE_RET tkl_queue_post(const TKL_QUEUE_HANDLE queue, void *data, uint32_t ti
  */
 OPERATE_RET tkl_queue_fetch(const TKL_QUEUE_HANDLE queue, void *msg, uint32_t timeout);
 
+/**
+ * @brief post many messages to the message queue under one lock and one wakeup
+ *
+ * @param[in] queue the handle of the queue
+ * @param[in] data count messages of msgsize bytes each, back to back
+ * @param[in] count the number of messages
+ * @param[in] timeout timeout time, waited only while the queue is full
+ * @param[out] posted the number of messages posted, always the leading ones of data, may be NULL
+ *
+ * @return OPRT_OK if at least one message was posted. Others on error, please refer to tuya_error_code.h
+ *
+ * @note posts what fits after the wait, call again with the rest to post them all
+ */
+OPERATE_RET tkl_queue_post_batch(const TKL_QUEUE_HANDLE queue, void *data, uint32_t count, uint32_t timeout, uint32_t *posted);
+
+/**
+ * @brief fetch many messages from the message queue under one lock and one wakeup
+ *
+ * @param[in] queue the message queue handle
+ * @param[out] buf room for max messages of msgsize bytes each
+ * @param[in] max the most messages to fetch
+ * @param[in] timeout timeout time, waited only while the queue is empty
+ * @param[out] got the number of messages fetched
+ *
+ * @return OPRT_OK if at least one message was fetched. Others on error, please refer to tuya_error_code.h
+ *
+ * @note takes what is queued after the wait, it does not wait to fill buf
+ */
+OPERATE_RET tkl_queue_fetch_batch(const TKL_QUEUE_HANDLE queue, void *buf, uint32_t max, uint32_t timeout, uint32_t *got);
+
+/**
+ * @brief reserve the next message slot of the queue, to be filled in place
+ *
+ * @param[in] queue the handle of the queue
+ * @param[out] msg the slot, msgsize bytes
+ * @param[in] timeout timeout time, waited only while the queue is full
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note only for TKL_QUEUE_FLAG_MPMC and TKL_QUEUE_FLAG_SPSC queues. Every
+ *       loan must be committed, on a MPMC queue the messages posted after it
+ *       are not fetched before it is committed
+ */
+OPERATE_RET tkl_queue_loan(const TKL_QUEUE_HANDLE queue, void **msg, uint32_t timeout);
+
+/**
+ * @brief post a slot got by tkl_queue_loan
+ *
+ * @param[in] queue the handle of the queue
+ * @param[in] msg the slot
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tkl_queue_commit(const TKL_QUEUE_HANDLE queue, void *msg);
+
+/**
+ * @brief take the oldest message of the queue in place
+ *
+ * @param[in] queue the message queue handle
+ * @param[out] msg the slot holding the message, msgsize bytes
+ * @param[in] timeout timeout time, waited only while the queue is empty
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note only for TKL_QUEUE_FLAG_MPMC and TKL_QUEUE_FLAG_SPSC queues. Every
+ *       borrow must be released, the slot is not posted to again before that
+ */
+OPERATE_RET tkl_queue_borrow(const TKL_QUEUE_HANDLE queue, void **msg, uint32_t timeout);
+
+/**
+ * @brief give back a slot got by tkl_queue_borrow
+ *
+ * @param[in] queue the message queue handle
+ * @param[in] msg the slot
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tkl_queue_release(const TKL_QUEUE_HANDLE queue, void *msg);
+
+/**
+ * @brief name the queue in its statistics
+ *
+ * @param[in] queue the message queue handle
+ * @param[in] name the name, cut to TKL_QUEUE_NAME_MAX - 1 chars
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tkl_queue_set_name(const TKL_QUEUE_HANDLE queue, const char *name);
+
+/**
+ * @brief get the statistics of a queue created with TKL_QUEUE_FLAG_STATS
+ *
+ * @param[in] queue the message queue handle
+ * @param[out] stat the statistics
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tkl_queue_stat_get(const TKL_QUEUE_HANDLE queue, TKL_QUEUE_STAT_T *stat);
+
+/**
+ * @brief call cb with the statistics of every queue created with TKL_QUEUE_FLAG_STATS
+ *
+ * @param[in] cb the callback
+ * @param[in] arg passed to cb
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note cb runs with the queue list locked, it must not create or free queues
+ */
+OPERATE_RET tkl_queue_stat_foreach(TKL_QUEUE_STAT_CB cb, void *arg);
+
 /**
  * @brief free the message queue
  *
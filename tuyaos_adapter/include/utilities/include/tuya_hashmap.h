@@ -44,14 +44,53 @@ typedef ANY_T MAP_T;
  */
 typedef ANY_T *ANY_T_ITER;
 
+/**
+ * @brief hashmap backends
+ *
+ */
+typedef enum {
+    TUYA_HASHMAP_CHAIN,     ///< a list per bucket, the bucket count is fixed at create
+    TUYA_HASHMAP_OPEN,      ///< robin hood open addressing, doubles a few slots per put at a time
+    TUYA_HASHMAP_CONCURRENT,///< thread safe, a list per bucket, striped locks for writers, no lock for readers
+    TUYA_HASHMAP_ARENA,     ///< open addressing, keys copied once per distinct key into chunks freed with the map
+    TUYA_HASHMAP_TYPE_MAX
+} TUYA_HASHMAP_TYPE_E;
+
 /**
  * @brief create a new empty hashmap
  * 
- * @param[in] table_size the hash table size
+ * @param[in] table_size the hash table size, rounded up to a power of two
  * @return a new empty hashmap 
+ *
+ * @note The backend is TUYA_HASHMAP_DEFAULT_TYPE, TUYA_HASHMAP_CHAIN unless defined otherwise,
+ *       the other backends are chosen by tuya_hashmap_new_ext.
  */
 MAP_T tuya_hashmap_new(uint32_t table_size);
 
+/**
+ * @brief create a new empty hashmap with the given backend
+ *
+ * @param[in] table_size the buckets of a chained map, the first slots of an
+ *            open addressing map, rounded up to a power of two
+ * @param[in] type the backend
+ * @return a new empty hashmap
+ *
+ * @note a TUYA_HASHMAP_OPEN map grows past table_size, moving the old slots
+ *       a few per put or remove, and an iterator of it is only valid until
+ *       the next put or remove
+ * @note a TUYA_HASHMAP_CONCURRENT map can be used from any threads without
+ *       a lock, its bucket count is fixed, get never blocks, put and remove
+ *       lock one of HASHMAP_LOCK_STRIPES locks, and a traversal must be done
+ *       between tuya_hashmap_read_lock and tuya_hashmap_read_unlock. A
+ *       remove never waits for the readers, also inside a read section, the
+ *       element is freed by a later put or remove once they all left
+ * @note a TUYA_HASHMAP_ARENA map is a TUYA_HASHMAP_OPEN map that copies the
+ *       keys, so the caller may free them after put, equal keys share one
+ *       copy. Key copies are only freed with the map, which frees the whole
+ *       arena at once, it is meant for short-lived maps.
+ */
+MAP_T tuya_hashmap_new_ext(uint32_t table_size, TUYA_HASHMAP_TYPE_E type);
+
 
 /**
  * @brief Add an element to the hashmap
@@ -62,6 +101,7 @@ MAP_T tuya_hashmap_new(uint32_t table_size);
  * @return MAP_OK on success, others on failed, please refer to the define of hashmap error code 
  * 
  * @note For same key, it does not replace it. it is inserted in the head of the list
+ * @note the key is kept by reference and must outlive the element, except in a TUYA_HASHMAP_ARENA map
  */
 int tuya_hashmap_put(MAP_T in, const char* key ,const ANY_T data);
 
@@ -116,6 +156,25 @@ int tuya_hashmap_remove(MAP_T in, char* key, ANY_T data);
  */
 void tuya_hashmap_free(MAP_T in);
 
+/**
+ * @brief enter a read section of a concurrent hashmap, elements removed
+ * meanwhile are not freed until it is left
+ *
+ * @param[in] in the hashmap
+ * @return the token for tuya_hashmap_read_unlock
+ *
+ * @note it never blocks, sections may nest, it does nothing for the other backends
+ */
+uint32_t tuya_hashmap_read_lock(MAP_T in);
+
+/**
+ * @brief leave a read section of a concurrent hashmap
+ *
+ * @param[in] in the hashmap
+ * @param[in] token what tuya_hashmap_read_lock returned
+ */
+void tuya_hashmap_read_unlock(MAP_T in, uint32_t token);
+
 /**
  * @brief get current size of the hashmap
  * 
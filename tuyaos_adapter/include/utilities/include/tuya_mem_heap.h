@@ -18,6 +18,7 @@ extern "C" {
 #endif
 
 #define MEM_HEAP_LIST_NUM (4)
+#define HEAP_FREE_HIST_NUM (32)
 
 typedef struct {
     void (*enter_critical)(void);
@@ -30,17 +31,38 @@ typedef struct {
     unsigned long free_size; // current free heap size
     unsigned long free_watermark; // minimum ever free heap size
     unsigned long max_free_block_size; //size of the largest free block
+    unsigned long realloc_fit; // realloc served by the old block as it is
+    unsigned long realloc_grow; // realloc grown in place into the next free block
+    unsigned long realloc_shrink; // realloc shrunk in place, the tail returned to the heap
+    unsigned long realloc_move; // realloc moved to a new block
+    unsigned long calloc_skip; // bytes calloc found zero already and did not clear
+    unsigned long free_block_num; // free blocks
+    unsigned long used_block_num; // blocks handed out
+    unsigned long free_hist[HEAP_FREE_HIST_NUM]; // free blocks of 2^n up to 2^(n+1)-1 bytes in free_hist[n]
 }heap_state_t;
 
+typedef enum {
+    HEAP_ALGO_FIRST_FIT = 0, // address ordered free list, first fit (default)
+    HEAP_ALGO_TLSF,          // two-level segregated fit, O(1) malloc/free
+}HEAP_ALGO_E;
+
 typedef void* HEAP_HANDLE;
 
+// called when an empty region is handed back by the heap, see tuya_mem_heap_add_region
+typedef void (*HEAP_REGION_RELEASE_CB)(void *start_addr, unsigned int size);
+
 int tuya_mem_heap_init(heap_context_t *ctx);
 int tuya_mem_heap_create(void *start_addr, unsigned int size, HEAP_HANDLE *handle);
+int tuya_mem_heap_create_ext(void *start_addr, unsigned int size, HEAP_ALGO_E algo, HEAP_HANDLE *handle);
 int tuya_mem_heap_delete(HEAP_HANDLE handle);
+int tuya_mem_heap_add_region(HEAP_HANDLE handle, void *start_addr, unsigned int size, BOOL_T zeroed, HEAP_REGION_RELEASE_CB release);
 void* tuya_mem_heap_malloc(HEAP_HANDLE handle, unsigned int size);
+void* tuya_mem_heap_malloc_aligned(HEAP_HANDLE handle, unsigned int size, unsigned int align);
 void* tuya_mem_heap_calloc(HEAP_HANDLE handle, unsigned int size);
 void* tuya_mem_heap_realloc(HEAP_HANDLE handle, void *ptr, unsigned int size);
 void tuya_mem_heap_free(HEAP_HANDLE handle, void *ptr);
+int tuya_mem_heap_malloc_batch(HEAP_HANDLE handle, unsigned int size, void **ptrs, int num);
+void tuya_mem_heap_free_batch(HEAP_HANDLE handle, void **ptrs, int num);
 void tuya_mem_heap_state(HEAP_HANDLE handle, heap_state_t *state);
 int tuya_mem_heap_available(HEAP_HANDLE handle);
 
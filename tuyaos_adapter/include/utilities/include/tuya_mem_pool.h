@@ -0,0 +1,90 @@
+/**
+ * @file tuya_mem_pool.h
+ * @brief tuya fixed size object pool module
+ * @version 1.0
+ * @date 2021-05-05
+ *
+ * @copyright Copyright 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+#ifndef __TUYA_MEM_POOL_H__
+#define __TUYA_MEM_POOL_H__
+
+#include "tuya_cloud_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void* MEM_POOL_HANDLE;
+
+/**
+ * @brief the statistics of a object pool
+ *
+ */
+typedef struct {
+    uint32_t obj_size;      ///< object size after alignment
+    uint32_t slab_num;      ///< slabs carved from the heap
+    uint32_t total;         ///< objects owned by the pool
+    uint32_t used;          ///< objects handed out now
+    uint32_t peak;          ///< maximum objects ever handed out
+    uint32_t alloc_cnt;     ///< successful allocations
+    uint32_t fail_cnt;      ///< allocations failed for lack of memory
+} MEM_POOL_STAT_T;
+
+/**
+ * @brief create a pool of fixed size objects
+ *
+ * @param[in] obj_size the object size
+ * @param[in] count the objects carved from the heap at once, the pool grows by the same count when exhausted
+ * @param[out] handle the pool handle
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_mem_pool_create(const uint32_t obj_size, const uint32_t count, MEM_POOL_HANDLE *handle);
+
+/**
+ * @brief take one object from the pool
+ *
+ * @param[in] handle the pool handle
+ *
+ * @return the object address, NULL on failed
+ */
+void *tuya_mem_pool_alloc(MEM_POOL_HANDLE handle);
+
+/**
+ * @brief give the object back to the pool
+ *
+ * @param[in] handle the pool handle
+ * @param[in] obj the object taken from this pool
+ *
+ * @return void
+ */
+void tuya_mem_pool_free(MEM_POOL_HANDLE handle, void *obj);
+
+/**
+ * @brief get the statistics of the pool
+ *
+ * @param[in] handle the pool handle
+ * @param[out] stat the statistics
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_mem_pool_stat(MEM_POOL_HANDLE handle, MEM_POOL_STAT_T *stat);
+
+/**
+ * @brief release the pool and all the slabs
+ *
+ * @param[in] handle the pool handle
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @warning objects still in use become invalid
+ */
+OPERATE_RET tuya_mem_pool_release(MEM_POOL_HANDLE handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TUYA_MEM_POOL_H__
@@ -0,0 +1,136 @@
+/**
+ * @file tuya_mem_prof.h
+ * @brief tuya allocation site heap profiler module
+ * @version 1.0
+ * @date 2021-05-05
+ *
+ * @copyright Copyright 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+#ifndef __TUYA_MEM_PROF_H__
+#define __TUYA_MEM_PROF_H__
+
+#include "tuya_cloud_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief the counters of one allocation site
+ *
+ * @note the counters are estimates, every sampled allocation stands for
+ *       sample rate allocations of the same size
+ */
+typedef struct {
+    const void *caller;     ///< return address of the allocation call, NULL for the sites beyond the table
+    int64_t live_bytes;     ///< bytes allocated and not freed yet
+    int64_t live_cnt;       ///< blocks allocated and not freed yet
+    int64_t alloc_cnt;      ///< allocations so far
+    int64_t peak_bytes;     ///< highest live_bytes seen
+} MEM_PROF_SITE_T;
+
+/**
+ * @brief the counters of all sites at one point in time
+ *
+ */
+typedef struct {
+    uint32_t sample_rate;   ///< sample rate when taken, 0 if stopped
+    uint32_t site_num;      ///< sites in the array
+    MEM_PROF_SITE_T site[0];
+} MEM_PROF_SNAPSHOT_T;
+
+/**
+ * @brief what the allocator keeps with a sampled block until it is freed
+ *
+ */
+typedef struct {
+    uint32_t site;          ///< site index
+    uint32_t weight;        ///< allocations the sample stands for
+    uint32_t size;          ///< requested size
+    uint32_t resv;
+} MEM_PROF_REC_T;
+
+/**
+ * @brief start sampling allocations
+ *
+ * @param[in] sample_rate record one in sample_rate allocations, 1 records all of them
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note the counters are kept over stop and start, blocks sampled before
+ *       stopping are still accounted when they are freed
+ */
+OPERATE_RET tuya_mem_prof_start(const uint32_t sample_rate);
+
+/**
+ * @brief stop sampling allocations
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_mem_prof_stop(void);
+
+/**
+ * @brief get the sample rate for the allocator
+ *
+ * @return the sample rate, 0 if the profiler is stopped
+ */
+uint32_t tuya_mem_prof_sample_rate(void);
+
+/**
+ * @brief account a sampled allocation, called by the allocator
+ *
+ * @param[in] caller the return address of the allocation call
+ * @param[in] size the requested size
+ * @param[in] weight the allocations the sample stands for
+ * @param[out] rec the record to keep with the block
+ *
+ * @return void
+ */
+void tuya_mem_prof_alloc(const void *caller, const uint32_t size, const uint32_t weight, MEM_PROF_REC_T *rec);
+
+/**
+ * @brief account the free of a sampled block, called by the allocator
+ *
+ * @param[in] rec the record kept with the block
+ *
+ * @return void
+ */
+void tuya_mem_prof_free(const MEM_PROF_REC_T *rec);
+
+/**
+ * @brief take a snapshot of the counters of all sites
+ *
+ * @param[out] snapshot the snapshot, release it by tuya_mem_prof_snapshot_free
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_mem_prof_snapshot(MEM_PROF_SNAPSHOT_T **snapshot);
+
+/**
+ * @brief get what changed between two snapshots
+ *
+ * @param[in] from the older snapshot
+ * @param[in] to the newer snapshot
+ * @param[out] diff the sites changed, sorted by live_bytes growth, release it by tuya_mem_prof_snapshot_free
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note live_bytes, live_cnt and alloc_cnt are the differences, peak_bytes is taken from to
+ */
+OPERATE_RET tuya_mem_prof_diff(const MEM_PROF_SNAPSHOT_T *from, const MEM_PROF_SNAPSHOT_T *to, MEM_PROF_SNAPSHOT_T **diff);
+
+/**
+ * @brief release a snapshot
+ *
+ * @param[in] snapshot the snapshot
+ *
+ * @return void
+ */
+void tuya_mem_prof_snapshot_free(MEM_PROF_SNAPSHOT_T *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TUYA_MEM_PROF_H__
@@ -19,6 +19,16 @@
 typedef void* TUYA_QUEUE_HANDLE;
 typedef BOOL_T (*TRAVERSE_CB)(void*item, void *ctx);
 
+/**
+ * @brief queue backends
+ *
+ */
+typedef enum {
+    TUYA_QUEUE_LIST,        ///< items allocated from a pool when queued, memory follows the use
+    TUYA_QUEUE_RING,        ///< one array of queue_len items allocated at create, no allocation after
+    TUYA_QUEUE_TYPE_MAX
+} TUYA_QUEUE_TYPE_E;
+
 /**
  * @brief create and initialize a queue (FIFO)
  * 
@@ -27,11 +37,29 @@ typedef BOOL_T (*TRAVERSE_CB)(void*item, void *ctx);
  * @param[out] handle the queue handle
  * 
  * @note items are queued by copy, not by reference. Each item on the queue must be the same size.
+ *       The backend is TUYA_QUEUE_DEFAULT_TYPE, TUYA_QUEUE_LIST unless defined otherwise,
+ *       a queue used on a hot path may opt into TUYA_QUEUE_RING by tuya_queue_create_ext.
  *
  * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
  */
 OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size, TUYA_QUEUE_HANDLE *handle);
 
+/**
+ * @brief create and initialize a queue (FIFO) with the given backend
+ *
+ * @param[in] queue_len the maximum number of items that the queue can contain.
+ * @param[in] item_size the number of bytes each item in the queue will require.
+ * @param[in] type the backend
+ * @param[out] handle the queue handle
+ *
+ * @note a TUYA_QUEUE_RING queue does get_batch with at most two copies and
+ *       delete_batch, input_instant and output in O(1), but allocates
+ *       queue_len * item_size at create, queue_len should be a real bound
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_queue_create_ext(const uint32_t queue_len, const uint32_t item_size, const TUYA_QUEUE_TYPE_E type, TUYA_QUEUE_HANDLE *handle);
+
 /**
  * @brief enqueue, append to the tail
  *
@@ -20,6 +20,13 @@
 
 typedef void* TUYA_RINGBUFF_T;
 
+/*
+ * the ringbuff needs no lock between one writer thread and one reader thread,
+ * more writers or readers, or reset and free, need the caller to serialize them
+ *
+ * a coverage type write never fails, the oldest data is dropped to make room
+ * and counted in tuya_ring_buff_lost_size_get
+ */
 typedef enum {
     OVERFLOW_STOP_TYPE = 0, ///< unread buff area will not be overwritten when writing overflow
     OVERFLOW_COVERAGE_TYPE, ///< unread buff area will be overwritten when writing overflow
@@ -29,12 +36,23 @@ typedef enum {
 /**
  * @brief ringbuff create
  *
- * @param[in]   len:      ringbuff length
+ * @param[in]   len:      ringbuff length, rounded up to a power of two, at most 2^30
  * @param[in]   type:     ringbuff type
  * @param[in]   ringbuff: ringbuff handle
  * @return  TRUE/ FALSE
  */
-OPERATE_RET tuya_ring_buff_create(uint16_t len, RINGBUFF_TYPE_E type, TUYA_RINGBUFF_T *ringbuff);
+OPERATE_RET tuya_ring_buff_create(uint32_t len, RINGBUFF_TYPE_E type, TUYA_RINGBUFF_T *ringbuff);
+
+/**
+ * @brief mirror ringbuff create, the buff is mapped twice in a row so every
+ * span is contiguous, also when it wraps around
+ *
+ * @param[in]   len:      ringbuff length, rounded up to a power of two, at least a page, at most 2^30
+ * @param[in]   type:     ringbuff type
+ * @param[in]   ringbuff: ringbuff handle
+ * @return  OPRT_OK on success, OPRT_NOT_SUPPORTED when not on linux
+ */
+OPERATE_RET tuya_ring_buff_create_mirror(uint32_t len, RINGBUFF_TYPE_E type, TUYA_RINGBUFF_T *ringbuff);
 
 /**
  * @brief ringbuff free
@@ -59,7 +77,7 @@ OPERATE_RET tuya_ring_buff_reset(TUYA_RINGBUFF_T ringbuff);
  * @param[in]   ringbuff: ringbuff handle
  * @return  size of ringbuff not used
  */
-uint16_t tuya_ring_buff_free_size_get(TUYA_RINGBUFF_T ringbuff);
+uint32_t tuya_ring_buff_free_size_get(TUYA_RINGBUFF_T ringbuff);
 
 /**
  * @brief ringbuff used size get
@@ -67,7 +85,7 @@ uint16_t tuya_ring_buff_free_size_get(TUYA_RINGBUFF_T ringbuff);
  * @param[in]   ringbuff: ringbuff handle
  * @return  size of ringbuff used
  */
-uint16_t tuya_ring_buff_used_size_get(TUYA_RINGBUFF_T ringbuff);
+uint32_t tuya_ring_buff_used_size_get(TUYA_RINGBUFF_T ringbuff);
 
 /**
  * @brief ringbuff data read 
@@ -77,7 +95,7 @@ uint16_t tuya_ring_buff_used_size_get(TUYA_RINGBUFF_T ringbuff);
  * @param[in]   len:      read len
  * @return  length of the data read
  */
-uint16_t tuya_ring_buff_read(TUYA_RINGBUFF_T ringbuff, void *data, uint16_t len);
+uint32_t tuya_ring_buff_read(TUYA_RINGBUFF_T ringbuff, void *data, uint32_t len);
 
 /**
  * @brief ringbuff data peek 
@@ -88,7 +106,7 @@ uint16_t tuya_ring_buff_read(TUYA_RINGBUFF_T ringbuff, void *data, uint16_t len)
  * @param[in]   len:      read len
  * @return  length of the data read
  */
-uint16_t tuya_ring_buff_peek(TUYA_RINGBUFF_T ringbuff, void *data, uint16_t len);
+uint32_t tuya_ring_buff_peek(TUYA_RINGBUFF_T ringbuff, void *data, uint32_t len);
 
 /**
  * @brief ringbuff data write 
@@ -97,8 +115,61 @@ uint16_t tuya_ring_buff_peek(TUYA_RINGBUFF_T ringbuff, void *data, uint16_t len)
  * @param[in]   data:     point to the data to be write 
  * @param[in]   len:      write len
  * @return  length of the data write
+ * @note    in coverage type all of len is taken, when len is over the buff
+ *          size only its last part is kept
+ */
+uint32_t tuya_ring_buff_write(TUYA_RINGBUFF_T ringbuff, const void *data, uint32_t len);
+
+/**
+ * @brief ringbuff overwritten size get
+ *
+ * @param[in]   ringbuff: ringbuff handle
+ * @return  bytes dropped unread by coverage writes since create or reset,
+ *          wraps at 2^32, compare two readings by unsigned subtraction
+ */
+uint32_t tuya_ring_buff_lost_size_get(TUYA_RINGBUFF_T ringbuff);
+
+/**
+ * @brief ringbuff readable span get, for parsing the data in place
+ *
+ * @param[in]   ringbuff: ringbuff handle
+ * @param[out]  span:     point to the first unread byte
+ * @return  length of the contiguous unread data at span, the part up to the
+ *          end of the buff unless the ringbuff is mirrored
+ */
+uint32_t tuya_ring_buff_read_span_get(TUYA_RINGBUFF_T ringbuff, void **span);
+
+/**
+ * @brief ringbuff read commit, drop data read from the span
+ *
+ * @param[in]   ringbuff: ringbuff handle
+ * @param[in]   len:      length of the data used
+ * @return  length of the data dropped
+ * @note    in coverage type 0 means the writer overwrote the span after it
+ *          was got, what was parsed from it is not valid, get the span again
+ */
+uint32_t tuya_ring_buff_read_commit(TUYA_RINGBUFF_T ringbuff, uint32_t len);
+
+/**
+ * @brief ringbuff writable span get, for read()/recv() straight into the buff
+ *
+ * @param[in]   ringbuff: ringbuff handle
+ * @param[out]  span:     point to where the next byte is written
+ * @return  length of the contiguous free space at span, the part up to the
+ *          end of the buff unless the ringbuff is mirrored
+ * @note    in coverage type the span only covers free space, drop old data
+ *          with tuya_ring_buff_read_commit or use tuya_ring_buff_write
+ */
+uint32_t tuya_ring_buff_write_span_get(TUYA_RINGBUFF_T ringbuff, void **span);
+
+/**
+ * @brief ringbuff write commit, publish data written into the span
+ *
+ * @param[in]   ringbuff: ringbuff handle
+ * @param[in]   len:      length of the data written
+ * @return  length of the data published
  */
-uint16_t tuya_ring_buff_write(TUYA_RINGBUFF_T ringbuff, const void *data, uint16_t len);
+uint32_t tuya_ring_buff_write_commit(TUYA_RINGBUFF_T ringbuff, uint32_t len);
 
 
 #ifdef __cplusplus
@@ -12,7 +12,6 @@
 #define _TUYA_SMARTPOINTER_H
 
 #include "tuya_cloud_types.h"
-#include "tkl_mutex.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,11 +20,15 @@ extern "C" {
 /**
  * @brief the reference data
  * 
+ * @note rfc and weak are changed atomically, read them with __atomic_load_n.
+ *       The strong references together hold one weak reference, the data is
+ *       released with the last strong reference, the smartpointer with the
+ *       last weak one.
  */
 typedef struct {
-    TKL_MUTEX_HANDLE mutex;
     BOOL_T malk;
     uint32_t rfc;
+    uint32_t weak;
     uint32_t data_len;
     void *data;
 }SMARTPOINTER_T;
@@ -59,11 +62,39 @@ void tuya_smartpointer_get(SMARTPOINTER_T *sp_data);
  */
 void tuya_smartpointer_put(SMARTPOINTER_T *sp_data);
 
+/**
+ * @brief get a weak reference, it keeps the smartpointer but not the data
+ * 
+ * @param[inout] sp_data the reference data, the caller holds a reference of it
+ * @return void 
+ */
+void tuya_smartpointer_weak_get(SMARTPOINTER_T *sp_data);
+
+/**
+ * @brief put a weak reference
+ * 
+ * @param[inout] sp_data the reference data 
+ * @return void 
+ */
+void tuya_smartpointer_weak_put(SMARTPOINTER_T *sp_data);
+
+/**
+ * @brief get a reference from a weak reference
+ * 
+ * @param[inout] sp_data the reference data, the caller holds a weak reference of it
+ * @return sp_data with the reference increased, NULL if the data is already released
+ * 
+ * @note the weak reference is kept, put it by tuya_smartpointer_weak_put
+ */
+SMARTPOINTER_T *tuya_smartpointer_weak_lock(SMARTPOINTER_T *sp_data);
+
 /**
  * @brief delete the reference data, ignore the reference
  * 
  * @param[inout] sp_data the reference data 
  * @return void 
+ * 
+ * @note it must not be used on a smartpointer with weak references
  */
 void tuya_smartpointer_del(SMARTPOINTER_T *sp_data);
 
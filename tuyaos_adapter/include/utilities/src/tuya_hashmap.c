@@ -3,160 +3,255 @@
  */
 #include "tuya_hashmap.h"
 #include "tuya_hlist.h"
+#include "tuya_mem_pool.h"
 #include "tkl_memory.h"
+#include "tkl_system.h"
 #include <string.h>
 
-/* We need to keep keys and values */
+#if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS == OPERATING_SYSTEM)
+#define HASHMAP_CREATE_LOCK(lock)   OPRT_OK
+#define HASHMAP_RELEASE_LOCK(lock)  OPRT_OK
+#define HASHMAP_LOCK(lock)   TKL_ENTER_CRITICAL()
+#define HASHMAP_UNLOCK(lock) TKL_EXIT_CRITICAL()
+#else
+#include "tkl_mutex.h"
+
+#define HASHMAP_CREATE_LOCK(lock)  tkl_mutex_create_init(&(lock))
+#define HASHMAP_RELEASE_LOCK(lock) tkl_mutex_release(lock)
+#define HASHMAP_LOCK(lock)   tkl_mutex_lock(lock)
+#define HASHMAP_UNLOCK(lock) tkl_mutex_unlock(lock)
+#endif
+
+/* elements carved from the pool at once */
+#ifndef HASHMAP_ELEMENT_POOL_NUM
+#define HASHMAP_ELEMENT_POOL_NUM 16
+#endif
+
+/* the backend of tuya_hashmap_new */
+#ifndef TUYA_HASHMAP_DEFAULT_TYPE
+#define TUYA_HASHMAP_DEFAULT_TYPE TUYA_HASHMAP_CHAIN
+#endif
+
+/* open addressing: percent of slots used before the table doubles */
+#ifndef HASHMAP_OPEN_MAX_LOAD
+#define HASHMAP_OPEN_MAX_LOAD 80
+#endif
+
+/* open addressing: old slots moved to the new table by each put or remove while resizing */
+#ifndef HASHMAP_OPEN_MIGRATE_NUM
+#define HASHMAP_OPEN_MIGRATE_NUM 8
+#endif
+
+#define HASHMAP_OPEN_MIN_SIZE 8
+
+/* concurrent: bucket locks, bucket i takes lock i % HASHMAP_LOCK_STRIPES, power of two */
+#ifndef HASHMAP_LOCK_STRIPES
+#define HASHMAP_LOCK_STRIPES 16
+#endif
+
+/* the stripe of a bucket, not of a hash, a small table has several hashes per bucket */
+#define HASHMAP_STRIPE(m, hash) ((m)->conc->stripe[((hash) & ((m)->table_size - 1)) & (HASHMAP_LOCK_STRIPES - 1)])
+
+/* concurrent: reader counters, threads spread over them by stack address, power of two */
+#ifndef HASHMAP_READ_SLOTS
+#define HASHMAP_READ_SLOTS 16
+#endif
+
+/* concurrent: removed elements gathered into a batch, a batch is freed once its grace period is over */
+#ifndef HASHMAP_RETIRE_NUM
+#define HASHMAP_RETIRE_NUM 32
+#endif
+
+#define HASHMAP_CACHE_LINE 64
+
+/* arena: keys are carved from chunks of this size, a longer key gets a chunk of its own */
+#ifndef HASHMAP_ARENA_CHUNK_SIZE
+#define HASHMAP_ARENA_CHUNK_SIZE 1024
+#endif
+
+/* the backends keeping entries in open addressing slots */
+#define HASHMAP_IS_OPEN(type) (TUYA_HASHMAP_OPEN == (type) || TUYA_HASHMAP_ARENA == (type))
+
+/* We need to keep keys and values, the hash and length are compared before the key */
 typedef struct _hashmap_element{
     char* key;
     ANY_T data;
+    uint32_t hash;
+    uint32_t keylen;
     HLIST_NODE node;
 } HASHMAP_ELEMENT_T;
 
+/*
+ * open addressing slot, robin hood ordered: dist is the probe distance + 1,
+ * 0 for an empty slot. A slot of the old table keeps its dist once moved or
+ * removed and gets a NULL key, so the probes of the others still work.
+ */
+typedef struct {
+    char* key;
+    ANY_T data;
+    uint32_t hash;
+    uint32_t keylen;
+    uint64_t seq;       // put order, the newest of equal keys is found first, never wraps
+    uint32_t dist;
+} HASHMAP_SLOT_T;
+
+/* readers inside a read section, by epoch parity, a cache line per slot */
+typedef struct {
+    uint32_t cnt[2];
+    uint8_t pad[HASHMAP_CACHE_LINE - 2 * sizeof(uint32_t)];
+} HASHMAP_READER_T;
+
+/*
+ * the part of a concurrent map: writers lock the stripe of the bucket and
+ * publish with release stores, readers take no lock, they only count
+ * themselves in a read slot so removed elements are freed after they left
+ */
+typedef struct {
+#if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS != OPERATING_SYSTEM)
+    TKL_MUTEX_HANDLE stripe[HASHMAP_LOCK_STRIPES];
+    TKL_MUTEX_HANDLE reclaim;
+#endif
+    uint32_t epoch;
+    HASHMAP_ELEMENT_T *retired;     // linked by node.pprev, readers only follow node.next
+    uint32_t retired_num;
+    HASHMAP_ELEMENT_T *grace;       // the batch waiting for the readers, NULL if none
+    uint32_t grace_flips;           // epoch flips done for grace, it is freed after the second drains
+    HASHMAP_READER_T reader[HASHMAP_READ_SLOTS];
+} HASHMAP_CONC_T;
+
+/* arena chunk, the first on the list is the one being carved */
+typedef struct hashmap_chunk {
+    struct hashmap_chunk *next;
+    uint32_t used;
+    uint32_t size;
+    char data[];
+} HASHMAP_CHUNK_T;
+
 /* A hashmap has some maximum size and current size,
  * as well as the data to hold. */
 typedef struct _hashmap_map{
     int size;
-    int table_size;
+    int table_size;     // power of two, buckets or slots
+    TUYA_HASHMAP_TYPE_E type;
     HLIST_HEAD *list;
+    MEM_POOL_HANDLE pool;
+    HASHMAP_SLOT_T *slots;
+    HASHMAP_SLOT_T *old;    // slots being moved to slots while resizing, else NULL
+    uint32_t old_size;
+    uint32_t migrate;       // next slot of old to move
+    uint64_t seq;
+    HASHMAP_CONC_T *conc;
+    HASHMAP_CHUNK_T *chunk;
 } HASHMAP_T;
 
 
-/* The implementation here was originally done by Gary S. Brown.  I have
-   borrowed the tables directly, and made some minor changes to the
-   crc32-function (including changing the interface). //ylo */
-
-  /* ============================================================= */
-  /*  COPYRIGHT (C) 1986 Gary S. Brown.  You may use this program, or       */
-  /*  code or tables extracted from it, as desired without restriction.     */
-  /*                                                                        */
-  /*  First, the polynomial itself and its table of feedback terms.  The    */
-  /*  polynomial is                                                         */
-  /*  X^32+X^26+X^23+X^22+X^16+X^12+X^11+X^10+X^8+X^7+X^5+X^4+X^2+X^1+X^0   */
-  /*                                                                        */
-  /*  Note that we take it "backwards" and put the highest-order term in    */
-  /*  the lowest-order bit.  The X^32 term is "implied"; the LSB is the     */
-  /*  X^31 term, etc.  The X^0 term (usually shown as "+1") results in      */
-  /*  the MSB being 1.                                                      */
-  /*                                                                        */
-  /*  Note that the usual hardware shift register implementation, which     */
-  /*  is what we're using (we're merely optimizing it by doing eight-bit    */
-  /*  chunks at a time) shifts bits into the lowest-order term.  In our     */
-  /*  implementation, that means shifting towards the right.  Why do we     */
-  /*  do it this way?  Because the calculated CRC must be transmitted in    */
-  /*  order from highest-order term to lowest-order term.  UARTs transmit   */
-  /*  characters in order from LSB to MSB.  By storing the CRC this way,    */
-  /*  we hand it to the UART in the order low-byte to high-byte; the UART   */
-  /*  sends each low-bit to hight-bit; and the result is transmission bit   */
-  /*  by bit from highest- to lowest-order term without requiring any bit   */
-  /*  shuffling on our part.  Reception works similarly.                    */
-  /*                                                                        */
-  /*  The feedback terms table consists of 256, 32-bit entries.  Notes:     */
-  /*                                                                        */
-  /*      The table can be generated at runtime if desired; code to do so   */
-  /*      is shown later.  It might not be obvious, but the feedback        */
-  /*      terms simply represent the results of eight shift/xor opera-      */
-  /*      tions for all combinations of data and CRC register values.       */
-  /*                                                                        */
-  /*      The values must be right-shifted by eight bits by the "updcrc"    */
-  /*      logic; the shift must be unsigned (bring in zeroes).  On some     */
-  /*      hardware you could probably optimize the shift in assembler by    */
-  /*      using byte-swap instructions.                                     */
-  /*      polynomial $edb88320                                              */
-  /*                                                                        */
-  /*  --------------------------------------------------------------------  */
-
-static uint32_t crc32_tab[] = {
-      0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
-      0x706af48fL, 0xe963a535L, 0x9e6495a3L, 0x0edb8832L, 0x79dcb8a4L,
-      0xe0d5e91eL, 0x97d2d988L, 0x09b64c2bL, 0x7eb17cbdL, 0xe7b82d07L,
-      0x90bf1d91L, 0x1db71064L, 0x6ab020f2L, 0xf3b97148L, 0x84be41deL,
-      0x1adad47dL, 0x6ddde4ebL, 0xf4d4b551L, 0x83d385c7L, 0x136c9856L,
-      0x646ba8c0L, 0xfd62f97aL, 0x8a65c9ecL, 0x14015c4fL, 0x63066cd9L,
-      0xfa0f3d63L, 0x8d080df5L, 0x3b6e20c8L, 0x4c69105eL, 0xd56041e4L,
-      0xa2677172L, 0x3c03e4d1L, 0x4b04d447L, 0xd20d85fdL, 0xa50ab56bL,
-      0x35b5a8faL, 0x42b2986cL, 0xdbbbc9d6L, 0xacbcf940L, 0x32d86ce3L,
-      0x45df5c75L, 0xdcd60dcfL, 0xabd13d59L, 0x26d930acL, 0x51de003aL,
-      0xc8d75180L, 0xbfd06116L, 0x21b4f4b5L, 0x56b3c423L, 0xcfba9599L,
-      0xb8bda50fL, 0x2802b89eL, 0x5f058808L, 0xc60cd9b2L, 0xb10be924L,
-      0x2f6f7c87L, 0x58684c11L, 0xc1611dabL, 0xb6662d3dL, 0x76dc4190L,
-      0x01db7106L, 0x98d220bcL, 0xefd5102aL, 0x71b18589L, 0x06b6b51fL,
-      0x9fbfe4a5L, 0xe8b8d433L, 0x7807c9a2L, 0x0f00f934L, 0x9609a88eL,
-      0xe10e9818L, 0x7f6a0dbbL, 0x086d3d2dL, 0x91646c97L, 0xe6635c01L,
-      0x6b6b51f4L, 0x1c6c6162L, 0x856530d8L, 0xf262004eL, 0x6c0695edL,
-      0x1b01a57bL, 0x8208f4c1L, 0xf50fc457L, 0x65b0d9c6L, 0x12b7e950L,
-      0x8bbeb8eaL, 0xfcb9887cL, 0x62dd1ddfL, 0x15da2d49L, 0x8cd37cf3L,
-      0xfbd44c65L, 0x4db26158L, 0x3ab551ceL, 0xa3bc0074L, 0xd4bb30e2L,
-      0x4adfa541L, 0x3dd895d7L, 0xa4d1c46dL, 0xd3d6f4fbL, 0x4369e96aL,
-      0x346ed9fcL, 0xad678846L, 0xda60b8d0L, 0x44042d73L, 0x33031de5L,
-      0xaa0a4c5fL, 0xdd0d7cc9L, 0x5005713cL, 0x270241aaL, 0xbe0b1010L,
-      0xc90c2086L, 0x5768b525L, 0x206f85b3L, 0xb966d409L, 0xce61e49fL,
-      0x5edef90eL, 0x29d9c998L, 0xb0d09822L, 0xc7d7a8b4L, 0x59b33d17L,
-      0x2eb40d81L, 0xb7bd5c3bL, 0xc0ba6cadL, 0xedb88320L, 0x9abfb3b6L,
-      0x03b6e20cL, 0x74b1d29aL, 0xead54739L, 0x9dd277afL, 0x04db2615L,
-      0x73dc1683L, 0xe3630b12L, 0x94643b84L, 0x0d6d6a3eL, 0x7a6a5aa8L,
-      0xe40ecf0bL, 0x9309ff9dL, 0x0a00ae27L, 0x7d079eb1L, 0xf00f9344L,
-      0x8708a3d2L, 0x1e01f268L, 0x6906c2feL, 0xf762575dL, 0x806567cbL,
-      0x196c3671L, 0x6e6b06e7L, 0xfed41b76L, 0x89d32be0L, 0x10da7a5aL,
-      0x67dd4accL, 0xf9b9df6fL, 0x8ebeeff9L, 0x17b7be43L, 0x60b08ed5L,
-      0xd6d6a3e8L, 0xa1d1937eL, 0x38d8c2c4L, 0x4fdff252L, 0xd1bb67f1L,
-      0xa6bc5767L, 0x3fb506ddL, 0x48b2364bL, 0xd80d2bdaL, 0xaf0a1b4cL,
-      0x36034af6L, 0x41047a60L, 0xdf60efc3L, 0xa867df55L, 0x316e8eefL,
-      0x4669be79L, 0xcb61b38cL, 0xbc66831aL, 0x256fd2a0L, 0x5268e236L,
-      0xcc0c7795L, 0xbb0b4703L, 0x220216b9L, 0x5505262fL, 0xc5ba3bbeL,
-      0xb2bd0b28L, 0x2bb45a92L, 0x5cb36a04L, 0xc2d7ffa7L, 0xb5d0cf31L,
-      0x2cd99e8bL, 0x5bdeae1dL, 0x9b64c2b0L, 0xec63f226L, 0x756aa39cL,
-      0x026d930aL, 0x9c0906a9L, 0xeb0e363fL, 0x72076785L, 0x05005713L,
-      0x95bf4a82L, 0xe2b87a14L, 0x7bb12baeL, 0x0cb61b38L, 0x92d28e9bL,
-      0xe5d5be0dL, 0x7cdcefb7L, 0x0bdbdf21L, 0x86d3d2d4L, 0xf1d4e242L,
-      0x68ddb3f8L, 0x1fda836eL, 0x81be16cdL, 0xf6b9265bL, 0x6fb077e1L,
-      0x18b74777L, 0x88085ae6L, 0xff0f6a70L, 0x66063bcaL, 0x11010b5cL,
-      0x8f659effL, 0xf862ae69L, 0x616bffd3L, 0x166ccf45L, 0xa00ae278L,
-      0xd70dd2eeL, 0x4e048354L, 0x3903b3c2L, 0xa7672661L, 0xd06016f7L,
-      0x4969474dL, 0x3e6e77dbL, 0xaed16a4aL, 0xd9d65adcL, 0x40df0b66L,
-      0x37d83bf0L, 0xa9bcae53L, 0xdebb9ec5L, 0x47b2cf7fL, 0x30b5ffe9L,
-      0xbdbdf21cL, 0xcabac28aL, 0x53b39330L, 0x24b4a3a6L, 0xbad03605L,
-      0xcdd70693L, 0x54de5729L, 0x23d967bfL, 0xb3667a2eL, 0xc4614ab8L,
-      0x5d681b02L, 0x2a6f2b94L, 0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL,
-      0x2d02ef8dL
-    };
-
-/* Return a 32-bit CRC of the contents of the buffer. */
-static uint32_t __crc32_hashmap(const uint8_t *s, uint32_t len)
-{
-    uint32_t i;
-    uint32_t crc32val;
-    
-    crc32val = 0;
-    for (i = 0;  i < len;  i ++) {
-        crc32val = crc32_tab[(crc32val ^ s[i]) & 0xff] ^ (crc32val >> 8);
-    }
+/*
+ * wyhash by Wang Yi, released into the public domain (The Unlicense), reads
+ * the key a word at a time, the 64x64->128 multiply falls back to four
+ * 32-bit multiplies where there is no 128-bit type
+ */
+static const uint64_t s_wyp[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static inline void __wymum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = *a;
+
+    r *= *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), lo = 0;
+    uint64_t c = t < rl;
+
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t __wymix(uint64_t a, uint64_t b)
+{
+    __wymum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t __wyr8(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t __wyr4(const uint8_t *p)
+{
+    uint32_t v;
 
-    return crc32val;
+    memcpy(&v, p, 4);
+    return v;
 }
 
+static uint64_t __wyhash(const uint8_t *p, uint32_t len)
+{
+    uint64_t seed = __wymix(s_wyp[0], s_wyp[1]);
+    uint64_t a = 0, b = 0, see1 = 0, see2 = 0;
+    uint32_t i = len;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (__wyr4(p) << 32) | __wyr4(p + ((len >> 3) << 2));
+            b = (__wyr4(p + len - 4) << 32) | __wyr4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+        }
+    } else {
+        if (i > 48) {
+            see1 = seed;
+            see2 = seed;
+            do {
+                seed = __wymix(__wyr8(p) ^ s_wyp[1], __wyr8(p + 8) ^ seed);
+                see1 = __wymix(__wyr8(p + 16) ^ s_wyp[2], __wyr8(p + 24) ^ see1);
+                see2 = __wymix(__wyr8(p + 32) ^ s_wyp[3], __wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = __wymix(__wyr8(p) ^ s_wyp[1], __wyr8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = __wyr8(p + i - 16);
+        b = __wyr8(p + i - 8);
+    }
+
+    a ^= s_wyp[1];
+    b ^= seed;
+    __wymum(&a, &b);
+
+    return __wymix(a ^ s_wyp[0] ^ len, b ^ s_wyp[1]);
+}
 
 /*
- * Hashing function for a string
+ * Hashing function for a string, also gives its length
  */
-uint32_t __hashmap_hash_int(HASHMAP_T * m, char* keystring)
+static uint32_t __hashmap_hash(const char *keystring, uint32_t *keylen)
 {
-    uint32_t key = __crc32_hashmap((uint8_t*)(keystring), strlen(keystring));
+    *keylen = strlen(keystring);
 
-    /* Robert Jenkins' 32 bit Mix Function */
-    key += (key << 12);
-    key ^= (key >> 22);
-    key += (key << 4);
-    key ^= (key >> 9);
-    key += (key << 10);
-    key ^= (key >> 2);
-    key += (key << 7);
-    key ^= (key >> 12);
-
-    /* Knuth's Multiplicative Method */
-    key = (key >> 3) * 2654435761;
+    return (uint32_t)__wyhash((const uint8_t *)keystring, *keylen);
+}
 
-    return key % m->table_size;
+static inline int __hashmap_key_equal(HASHMAP_ELEMENT_T *element, const char *key, uint32_t hash, uint32_t keylen)
+{
+    return element->hash == hash && element->keylen == keylen && memcmp(element->key, key, keylen) == 0;
 }
 
 static HASHMAP_ELEMENT_T *__hash_find_next_element(HASHMAP_ELEMENT_T *curr)
@@ -164,8 +259,7 @@ static HASHMAP_ELEMENT_T *__hash_find_next_element(HASHMAP_ELEMENT_T *curr)
     HLIST_NODE *pos = NULL;
     HASHMAP_ELEMENT_T *tmp_element = NULL;
     HLIST_FOR_EACH_ENTRY_CURR(tmp_element, HASHMAP_ELEMENT_T, pos, &(curr->node), node) {
-        if(strlen(curr->key) == strlen(tmp_element->key) && \
-           (strcmp(curr->key,tmp_element->key) == 0)) {
+        if(__hashmap_key_equal(tmp_element, curr->key, curr->hash, curr->keylen)) {
             return tmp_element;
         }
     }
@@ -174,8 +268,9 @@ static HASHMAP_ELEMENT_T *__hash_find_next_element(HASHMAP_ELEMENT_T *curr)
 
 static HASHMAP_ELEMENT_T *__hash_find(HASHMAP_T *m, char* key)
 {
-    int curr = __hashmap_hash_int(m, key);
-    HLIST_HEAD *list = &(m->list[curr]);
+    uint32_t keylen = 0;
+    uint32_t hash = __hashmap_hash(key, &keylen);
+    HLIST_HEAD *list = &(m->list[hash & (m->table_size - 1)]);
     if(tuya_hlist_empty(list)) {
         return NULL;
     }
@@ -183,8 +278,7 @@ static HASHMAP_ELEMENT_T *__hash_find(HASHMAP_T *m, char* key)
     HLIST_NODE *pos = NULL;
     HASHMAP_ELEMENT_T *tmp_element = NULL;
     HLIST_FOR_EACH_ENTRY(tmp_element, HASHMAP_ELEMENT_T, pos, list, node) {
-        if(strlen(key) == strlen(tmp_element->key) && \
-           (strcmp(key,tmp_element->key) == 0)) {
+        if(__hashmap_key_equal(tmp_element, key, hash, keylen)) {
             return tmp_element;
         }
     }
@@ -192,23 +286,525 @@ static HASHMAP_ELEMENT_T *__hash_find(HASHMAP_T *m, char* key)
     return NULL;
 }
 
+static inline int __open_key_equal(HASHMAP_SLOT_T *slot, const char *key, uint32_t hash, uint32_t keylen)
+{
+    return slot->key && slot->hash == hash && slot->keylen == keylen && memcmp(slot->key, key, keylen) == 0;
+}
+
+/* robin hood insert, a slot that probed less gives its place up */
+static void __open_insert(HASHMAP_SLOT_T *slots, uint32_t size, const HASHMAP_SLOT_T *slot)
+{
+    HASHMAP_SLOT_T cur = *slot, tmp;
+    uint32_t mask = size - 1;
+    uint32_t idx = cur.hash & mask;
+
+    for (cur.dist = 1; ; idx = (idx + 1) & mask, cur.dist++) {
+        if (0 == slots[idx].dist) {
+            slots[idx] = cur;
+            return;
+        }
+        if (slots[idx].dist < cur.dist) {
+            tmp = slots[idx];
+            slots[idx] = cur;
+            cur = tmp;
+        }
+    }
+}
+
+/*
+ * the newest slot of key put before seq whose data is data, any data if
+ * data is NULL, newer than best, the probe ends at a slot that probed less
+ */
+static HASHMAP_SLOT_T *__open_find_in(HASHMAP_SLOT_T *slots, uint32_t size, const char *key, uint32_t hash, uint32_t keylen,
+                                      uint64_t before, ANY_T data, HASHMAP_SLOT_T *best)
+{
+    uint32_t mask = size - 1;
+    uint32_t idx = hash & mask;
+    uint32_t dist = 1;
+    HASHMAP_SLOT_T *slot = NULL;
+
+    for (; slots[idx].dist >= dist; idx = (idx + 1) & mask, dist++) {
+        slot = &slots[idx];
+        if (slot->seq >= before || (best && slot->seq <= best->seq)) {
+            continue;
+        }
+        if ((NULL == data || slot->data == data) && __open_key_equal(slot, key, hash, keylen)) {
+            best = slot;
+        }
+    }
+
+    return best;
+}
+
+static HASHMAP_SLOT_T *__open_find(HASHMAP_T *m, const char *key, uint32_t hash, uint32_t keylen, uint64_t before, ANY_T data)
+{
+    HASHMAP_SLOT_T *best = __open_find_in(m->slots, m->table_size, key, hash, keylen, before, data, NULL);
+
+    if (m->old) {
+        best = __open_find_in(m->old, m->old_size, key, hash, keylen, before, data, best);
+    }
+
+    return best;
+}
+
+/* move num slots of the old table, the one being resized, to the new one */
+static void __open_migrate(HASHMAP_T *m, uint32_t num)
+{
+    HASHMAP_SLOT_T *slot = NULL;
+
+    while (m->old && num--) {
+        slot = &m->old[m->migrate];
+        if (slot->key) {
+            __open_insert(m->slots, m->table_size, slot);
+            slot->key = NULL;
+        }
+        if (++m->migrate == m->old_size) {
+            tkl_system_free(m->old);
+            m->old = NULL;
+        }
+    }
+}
+
+/* start moving to a table twice the size, the slots move a few per put or remove */
+static int __open_grow(HASHMAP_T *m)
+{
+    HASHMAP_SLOT_T *slots = NULL;
+
+    if (m->old) {
+        __open_migrate(m, m->old_size);
+    }
+
+    slots = (HASHMAP_SLOT_T *)tkl_system_malloc(2 * m->table_size * sizeof(HASHMAP_SLOT_T));
+    if (NULL == slots) {
+        return MAP_OMEM;
+    }
+    memset(slots, 0, 2 * m->table_size * sizeof(HASHMAP_SLOT_T));
+
+    m->old = m->slots;
+    m->old_size = m->table_size;
+    m->migrate = 0;
+    m->slots = slots;
+    m->table_size *= 2;
+
+    return MAP_OK;
+}
+
+static int __open_put(HASHMAP_T *m, const char *key, uint32_t hash, uint32_t keylen, const ANY_T data)
+{
+    HASHMAP_SLOT_T slot;
+
+    __open_migrate(m, HASHMAP_OPEN_MIGRATE_NUM);
+
+    // a failed grow is fine while the table still has room
+    if ((uint64_t)(m->size + 1) * 100 > (uint64_t)m->table_size * HASHMAP_OPEN_MAX_LOAD &&
+        MAP_OK != __open_grow(m) && m->size + 1 >= m->table_size) {
+        return MAP_OMEM;
+    }
+
+    slot.key = (char *)key;
+    slot.data = data;
+    slot.hash = hash;
+    slot.keylen = keylen;
+    slot.seq = m->seq++;
+    __open_insert(m->slots, m->table_size, &slot);
+    m->size++;
+
+    return MAP_OK;
+}
+
+/* backward shift delete in the new table, only a NULL key in the old one */
+static void __open_delete(HASHMAP_T *m, HASHMAP_SLOT_T *slot)
+{
+    uint32_t mask = m->table_size - 1;
+    uint32_t idx = 0, next = 0;
+
+    m->size--;
+    if (m->old && slot >= m->old && slot < m->old + m->old_size) {
+        slot->key = NULL;
+        return;
+    }
+
+    for (idx = slot - m->slots; ; idx = next) {
+        next = (idx + 1) & mask;
+        if (m->slots[next].dist <= 1) {
+            break;
+        }
+        m->slots[idx] = m->slots[next];
+        m->slots[idx].dist--;
+    }
+    memset(&m->slots[idx], 0, sizeof(HASHMAP_SLOT_T));
+}
+
+static int __open_remove(HASHMAP_T *m, const char *key, ANY_T data)
+{
+    uint32_t keylen = 0;
+    uint32_t hash = __hashmap_hash(key, &keylen);
+    HASHMAP_SLOT_T *slot = __open_find(m, key, hash, keylen, m->seq, data);
+
+    if (NULL == slot) {
+        return MAP_MISSING;
+    }
+    __open_delete(m, slot);
+    __open_migrate(m, HASHMAP_OPEN_MIGRATE_NUM);
+
+    return MAP_OK;
+}
+
+/* bump allocate from the current chunk, a new one when it is full */
+static char *__arena_alloc(HASHMAP_T *m, uint32_t len)
+{
+    HASHMAP_CHUNK_T *chunk = m->chunk;
+    uint32_t size = HASHMAP_ARENA_CHUNK_SIZE;
+
+    if (chunk && chunk->size - chunk->used >= len) {
+        chunk->used += len;
+        return &chunk->data[chunk->used - len];
+    }
+
+    if (len > HASHMAP_ARENA_CHUNK_SIZE / 4) {
+        size = len;
+    }
+    chunk = (HASHMAP_CHUNK_T *)tkl_system_malloc(sizeof(HASHMAP_CHUNK_T) + size);
+    if (NULL == chunk) {
+        return NULL;
+    }
+    chunk->size = size;
+    chunk->used = len;
+
+    // a key with a chunk of its own leaves the current one at the head
+    if (size == len && m->chunk) {
+        chunk->next = m->chunk->next;
+        m->chunk->next = chunk;
+    } else {
+        chunk->next = m->chunk;
+        m->chunk = chunk;
+    }
+
+    return chunk->data;
+}
+
+/* the key is copied once, later puts of an equal key share the copy */
+static int __arena_put(HASHMAP_T *m, const char *key, const ANY_T data)
+{
+    uint32_t keylen = 0;
+    uint32_t hash = __hashmap_hash(key, &keylen);
+    HASHMAP_SLOT_T *slot = __open_find(m, key, hash, keylen, m->seq, NULL);
+    char *copy = NULL;
+
+    if (slot) {
+        copy = slot->key;
+    } else {
+        copy = __arena_alloc(m, keylen + 1);
+        if (NULL == copy) {
+            return MAP_OMEM;
+        }
+        memcpy(copy, key, keylen + 1);
+    }
+
+    return __open_put(m, copy, hash, keylen, data);
+}
+
+static void __arena_release(HASHMAP_T *m)
+{
+    HASHMAP_CHUNK_T *chunk = NULL;
+
+    while (m->chunk) {
+        chunk = m->chunk;
+        m->chunk = chunk->next;
+        tkl_system_free(chunk);
+    }
+}
+
+/* threads have their stacks apart, the slot only spreads them, any slot is correct */
+static inline uint32_t __conc_reader_slot(void)
+{
+    uintptr_t sp = (uintptr_t)&sp;
+
+    return ((uint32_t)(sp >> 16) * 0x9E3779B1u >> 24) & (HASHMAP_READ_SLOTS - 1);
+}
+
+/*
+ * count the reader in the slot of the current epoch parity, a writer flipping
+ * the epoch in between would not wait for it, so check again and move over
+ */
+static uint32_t __conc_read_lock(HASHMAP_CONC_T *conc)
+{
+    uint32_t slot = __conc_reader_slot();
+    uint32_t e = 0;
+
+    for (;;) {
+        e = __atomic_load_n(&conc->epoch, __ATOMIC_SEQ_CST) & 1;
+        __atomic_fetch_add(&conc->reader[slot].cnt[e], 1, __ATOMIC_SEQ_CST);
+        if ((__atomic_load_n(&conc->epoch, __ATOMIC_SEQ_CST) & 1) == e) {
+            return (slot << 1) | e;
+        }
+        __atomic_fetch_sub(&conc->reader[slot].cnt[e], 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void __conc_read_unlock(HASHMAP_CONC_T *conc, uint32_t token)
+{
+    __atomic_fetch_sub(&conc->reader[token >> 1].cnt[token & 1], 1, __ATOMIC_RELEASE);
+}
+
+static uint32_t __conc_readers(HASHMAP_CONC_T *conc, uint32_t e)
+{
+    uint32_t i = 0, cnt = 0;
+
+    for (i = 0; i < HASHMAP_READ_SLOTS; i++) {
+        cnt += __atomic_load_n(&conc->reader[i].cnt[e], __ATOMIC_ACQUIRE);
+    }
+
+    return cnt;
+}
+
+static void __conc_free_list(HASHMAP_T *m, HASHMAP_ELEMENT_T *element)
+{
+    HASHMAP_ELEMENT_T *next = NULL;
+
+    for (; element; element = next) {
+        next = (HASHMAP_ELEMENT_T *)element->node.pprev;
+        tuya_mem_pool_free(m->pool, element);
+    }
+}
+
+/*
+ * move the grace period on as far as it goes without waiting: a batch is
+ * closed by flipping the epoch, once the old parity drained the epoch is
+ * flipped again, as readers of both parities may have been inside, and the
+ * batch is freed once that one drained too. A reader still inside, even the
+ * caller, only holds the batch back. Called with the reclaim lock.
+ */
+static void __conc_reclaim(HASHMAP_T *m)
+{
+    HASHMAP_CONC_T *conc = m->conc;
+
+    for (;;) {
+        if (NULL == conc->grace) {
+            if (conc->retired_num < HASHMAP_RETIRE_NUM) {
+                return;
+            }
+            __atomic_store_n(&conc->grace, conc->retired, __ATOMIC_RELAXED);
+            conc->retired = NULL;
+            conc->retired_num = 0;
+            conc->grace_flips = 1;
+            __atomic_fetch_add(&conc->epoch, 1, __ATOMIC_SEQ_CST);
+        }
+
+        if (__conc_readers(conc, (__atomic_load_n(&conc->epoch, __ATOMIC_RELAXED) - 1) & 1)) {
+            return;
+        }
+        if (1 == conc->grace_flips) {
+            conc->grace_flips = 2;
+            __atomic_fetch_add(&conc->epoch, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        __conc_free_list(m, conc->grace);
+        __atomic_store_n(&conc->grace, NULL, __ATOMIC_RELAXED);
+    }
+}
+
+/* free the element once no reader can see it, never waits for the readers */
+static void __conc_retire(HASHMAP_T *m, HASHMAP_ELEMENT_T *element)
+{
+    HASHMAP_CONC_T *conc = m->conc;
+
+    HASHMAP_LOCK(conc->reclaim);
+    element->node.pprev = (HLIST_NODE **)conc->retired;
+    conc->retired = element;
+    conc->retired_num++;
+    __conc_reclaim(m);
+    HASHMAP_UNLOCK(conc->reclaim);
+}
+
+static HASHMAP_ELEMENT_T *__conc_find(HLIST_NODE *pos, const char *key, uint32_t hash, uint32_t keylen)
+{
+    HASHMAP_ELEMENT_T *element = NULL;
+
+    for (; pos; pos = __atomic_load_n(&pos->next, __ATOMIC_ACQUIRE)) {
+        element = HLIST_ENTRY(pos, HASHMAP_ELEMENT_T, node);
+        if (__hashmap_key_equal(element, key, hash, keylen)) {
+            return element;
+        }
+    }
+
+    return NULL;
+}
+
+static int __conc_put(HASHMAP_T *m, const char *key, const ANY_T data)
+{
+    HASHMAP_ELEMENT_T *element = (HASHMAP_ELEMENT_T *)tuya_mem_pool_alloc(m->pool);
+    HLIST_HEAD *list = NULL;
+    HLIST_NODE *first = NULL;
+
+    if (NULL == element) {
+        return MAP_OMEM;
+    }
+    element->key = (char *)key;
+    element->data = data;
+    element->hash = __hashmap_hash(key, &element->keylen);
+    list = &(m->list[element->hash & (m->table_size - 1)]);
+
+    HASHMAP_LOCK(HASHMAP_STRIPE(m, element->hash));
+    first = list->first;
+    element->node.next = first;
+    element->node.pprev = &list->first;
+    if (first) {
+        first->pprev = &element->node.next;
+    }
+    // readers see the element filled in
+    __atomic_store_n(&list->first, &element->node, __ATOMIC_RELEASE);
+    HASHMAP_UNLOCK(HASHMAP_STRIPE(m, element->hash));
+
+    __atomic_fetch_add(&m->size, 1, __ATOMIC_RELAXED);
+
+    // a batch left waiting by the last remove is freed by whoever comes next
+    if (__atomic_load_n(&m->conc->grace, __ATOMIC_RELAXED)) {
+        HASHMAP_LOCK(m->conc->reclaim);
+        __conc_reclaim(m);
+        HASHMAP_UNLOCK(m->conc->reclaim);
+    }
+
+    return MAP_OK;
+}
+
+static int __conc_remove(HASHMAP_T *m, const char *key, ANY_T data)
+{
+    uint32_t keylen = 0;
+    uint32_t hash = __hashmap_hash(key, &keylen);
+    HLIST_HEAD *list = &(m->list[hash & (m->table_size - 1)]);
+    HASHMAP_ELEMENT_T *element = NULL;
+    HLIST_NODE *pos = NULL, *next = NULL;
+
+    HASHMAP_LOCK(HASHMAP_STRIPE(m, hash));
+    for (pos = list->first; pos; pos = pos->next) {
+        element = HLIST_ENTRY(pos, HASHMAP_ELEMENT_T, node);
+        if (__hashmap_key_equal(element, key, hash, keylen) && (NULL == data || element->data == data)) {
+            break;
+        }
+    }
+    if (pos) {
+        // a reader on the element still goes on by its next
+        next = pos->next;
+        __atomic_store_n(pos->pprev, next, __ATOMIC_RELEASE);
+        if (next) {
+            next->pprev = pos->pprev;
+        }
+    }
+    HASHMAP_UNLOCK(HASHMAP_STRIPE(m, hash));
+
+    if (NULL == pos) {
+        return MAP_MISSING;
+    }
+    __atomic_fetch_sub(&m->size, 1, __ATOMIC_RELAXED);
+    __conc_retire(m, element);
+
+    return MAP_OK;
+}
+
+static int __conc_create(HASHMAP_T *m)
+{
+    m->conc = (HASHMAP_CONC_T *)tkl_system_malloc(sizeof(HASHMAP_CONC_T));
+    if (NULL == m->conc) {
+        return MAP_OMEM;
+    }
+    memset(m->conc, 0, sizeof(HASHMAP_CONC_T));
+
+#if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS != OPERATING_SYSTEM)
+    uint32_t i = 0;
+
+    for (i = 0; i < HASHMAP_LOCK_STRIPES; i++) {
+        if (OPRT_OK != HASHMAP_CREATE_LOCK(m->conc->stripe[i])) {
+            return MAP_OMEM;
+        }
+    }
+    if (OPRT_OK != HASHMAP_CREATE_LOCK(m->conc->reclaim)) {
+        return MAP_OMEM;
+    }
+#endif
+
+    return MAP_OK;
+}
+
+static void __conc_release(HASHMAP_T *m)
+{
+    // no reader is left when the map is freed
+    __conc_free_list(m, m->conc->retired);
+    __conc_free_list(m, m->conc->grace);
+
+#if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS != OPERATING_SYSTEM)
+    uint32_t i = 0;
+
+    for (i = 0; i < HASHMAP_LOCK_STRIPES; i++) {
+        if (m->conc->stripe[i]) {
+            HASHMAP_RELEASE_LOCK(m->conc->stripe[i]);
+        }
+    }
+    if (m->conc->reclaim) {
+        HASHMAP_RELEASE_LOCK(m->conc->reclaim);
+    }
+#endif
+    tkl_system_free(m->conc);
+    m->conc = NULL;
+}
+
 /**
  * @brief create a new empty hashmap
  * 
- * @param[in] table_size the hash table size
+ * @param[in] table_size the hash table size, rounded up to a power of two
  * @return a new empty hashmap 
+ *
+ * @note The backend is TUYA_HASHMAP_DEFAULT_TYPE, TUYA_HASHMAP_CHAIN unless defined otherwise,
+ *       the other backends are chosen by tuya_hashmap_new_ext.
  */
 MAP_T tuya_hashmap_new(uint32_t table_size)
 {
-    if(0 == table_size) {
+    return tuya_hashmap_new_ext(table_size, TUYA_HASHMAP_DEFAULT_TYPE);
+}
+
+/**
+ * @brief create a new empty hashmap with the given backend
+ *
+ * @param[in] table_size the buckets of a chained map, the first slots of an
+ *            open addressing map, rounded up to a power of two
+ * @param[in] type the backend
+ * @return a new empty hashmap
+ */
+MAP_T tuya_hashmap_new_ext(uint32_t table_size, TUYA_HASHMAP_TYPE_E type)
+{
+    uint32_t size = 1;
+
+    if(0 == table_size || table_size > 0x40000000 || type >= TUYA_HASHMAP_TYPE_MAX) {
         return NULL;
     }
 
+    if(HASHMAP_IS_OPEN(type) && table_size < HASHMAP_OPEN_MIN_SIZE) {
+        table_size = HASHMAP_OPEN_MIN_SIZE;
+    }
+
+    // buckets are picked by masking the hash
+    while(size < table_size) {
+        size <<= 1;
+    }
+    table_size = size;
+
     HASHMAP_T* m = (HASHMAP_T*) tkl_system_malloc(sizeof(HASHMAP_T));
     if(!m) {
         goto err;
     }
     memset(m,0,sizeof(HASHMAP_T));
+    m->type = type;
+    m->table_size = table_size;
+
+    if(HASHMAP_IS_OPEN(type)) {
+        m->slots = (HASHMAP_SLOT_T *)tkl_system_malloc(table_size*sizeof(HASHMAP_SLOT_T));
+        if(!m->slots) {
+            goto err;
+        }
+        memset(m->slots,0,sizeof(HASHMAP_SLOT_T)*table_size);
+        return m;
+    }
 
     m->list = (HLIST_HEAD *)tkl_system_malloc(table_size*sizeof(HLIST_HEAD));
     if(!m->list) {
@@ -216,7 +812,14 @@ MAP_T tuya_hashmap_new(uint32_t table_size)
     }
     
     memset(m->list,0,sizeof(HLIST_HEAD)*table_size);
-    m->table_size = table_size;
+
+    if(OPRT_OK != tuya_mem_pool_create(sizeof(HASHMAP_ELEMENT_T), HASHMAP_ELEMENT_POOL_NUM, &m->pool)) {
+        goto err;
+    }
+
+    if(TUYA_HASHMAP_CONCURRENT == type && MAP_OK != __conc_create(m)) {
+        goto err;
+    }
 
     return m;
 
@@ -236,21 +839,34 @@ err:
  * @return MAP_OK on success, others on failed, please refer to the define of hashmap error code 
  * 
  * @note For same key, it does not replace it. it is inserted in the head of the list
+ * @note the key is kept by reference and must outlive the element, except in a TUYA_HASHMAP_ARENA map
  */
 int tuya_hashmap_put(MAP_T in, const char* key ,const ANY_T data)
 {
-    HASHMAP_ELEMENT_T *element = (HASHMAP_ELEMENT_T *)tkl_system_malloc(sizeof(HASHMAP_ELEMENT_T));
+    HASHMAP_T* m = (HASHMAP_T *)in;
+    if(TUYA_HASHMAP_ARENA == m->type) {
+        return __arena_put(m, key, data);
+    }
+    if(TUYA_HASHMAP_OPEN == m->type) {
+        uint32_t keylen = 0;
+        uint32_t hash = __hashmap_hash(key, &keylen);
+
+        return __open_put(m, key, hash, keylen, data);
+    }
+    if(TUYA_HASHMAP_CONCURRENT == m->type) {
+        return __conc_put(m, key, data);
+    }
+
+    HASHMAP_ELEMENT_T *element = (HASHMAP_ELEMENT_T *)tuya_mem_pool_alloc(m->pool);
     if(NULL == element) {
         return MAP_OMEM;
     }
     memset(element,0,sizeof(HASHMAP_ELEMENT_T));
     element->key = (char *)key;
     element->data = data;
+    element->hash = __hashmap_hash(key, &element->keylen);
 
-    int curr = 0;
-    HASHMAP_T* m = (HASHMAP_T *)in;
-    curr = __hashmap_hash_int(m, element->key);
-    tuya_hlist_add_head(&(element->node), &(m->list[curr]));
+    tuya_hlist_add_head(&(element->node), &(m->list[element->hash & (m->table_size - 1)]));
     m->size++;
 
     return MAP_OK;
@@ -268,6 +884,27 @@ int tuya_hashmap_put(MAP_T in, const char* key ,const ANY_T data)
 int tuya_hashmap_get(MAP_T in, const char* key, ANY_T *arg)
 {
     HASHMAP_T *m = (HASHMAP_T *) in;
+    if(HASHMAP_IS_OPEN(m->type)) {
+        uint32_t keylen = 0;
+        uint32_t hash = __hashmap_hash(key, &keylen);
+        HASHMAP_SLOT_T *slot = __open_find(m, key, hash, keylen, m->seq, NULL);
+
+        *arg = slot ? slot->data : NULL;
+        return slot ? MAP_OK : MAP_MISSING;
+    }
+    if(TUYA_HASHMAP_CONCURRENT == m->type) {
+        uint32_t keylen = 0;
+        uint32_t hash = __hashmap_hash(key, &keylen);
+        uint32_t token = __conc_read_lock(m->conc);
+        HASHMAP_ELEMENT_T *found = __conc_find(__atomic_load_n(&m->list[hash & (m->table_size - 1)].first, __ATOMIC_ACQUIRE),
+                                               key, hash, keylen);
+
+        // the data is read before the element may be freed
+        *arg = found ? found->data : NULL;
+        __conc_read_unlock(m->conc, token);
+        return found ? MAP_OK : MAP_MISSING;
+    }
+
     HASHMAP_ELEMENT_T *element = __hash_find(m,(char *)key);
     if(NULL == element) {
         *arg = NULL;
@@ -293,6 +930,37 @@ int tuya_hashmap_data_traversal(MAP_T in, const char* key, ANY_T_ITER *arg_itera
     HASHMAP_T *m = (HASHMAP_T *) in;
     HASHMAP_ELEMENT_T *element = NULL;
 
+    if(HASHMAP_IS_OPEN(m->type)) {
+        uint32_t keylen = 0;
+        uint32_t hash = __hashmap_hash(key, &keylen);
+        uint64_t before = m->seq;
+        HASHMAP_SLOT_T *slot = NULL;
+
+        if(NULL != *arg_iterator) {
+            before = HLIST_ENTRY((*arg_iterator), HASHMAP_SLOT_T, data)->seq;
+        }
+        slot = __open_find(m, key, hash, keylen, before, NULL);
+
+        *arg_iterator = slot ? &(slot->data) : NULL;
+        return slot ? MAP_OK : MAP_MISSING;
+    }
+    if(TUYA_HASHMAP_CONCURRENT == m->type) {
+        uint32_t keylen = 0;
+        uint32_t hash = __hashmap_hash(key, &keylen);
+        HLIST_NODE *pos = NULL;
+
+        // the caller holds tuya_hashmap_read_lock over the whole traversal
+        if(NULL == *arg_iterator) {
+            pos = __atomic_load_n(&m->list[hash & (m->table_size - 1)].first, __ATOMIC_ACQUIRE);
+        } else {
+            pos = __atomic_load_n(&HLIST_ENTRY((*arg_iterator), HASHMAP_ELEMENT_T, data)->node.next, __ATOMIC_ACQUIRE);
+        }
+        element = __conc_find(pos, key, hash, keylen);
+
+        *arg_iterator = element ? &(element->data) : NULL;
+        return element ? MAP_OK : MAP_MISSING;
+    }
+
     if(NULL == *arg_iterator) {
         element = __hash_find(m,(char *)key);
     } else {
@@ -323,8 +991,16 @@ int tuya_hashmap_data_traversal(MAP_T in, const char* key, ANY_T_ITER *arg_itera
 int tuya_hashmap_remove(MAP_T in, char* key, ANY_T data)
 {
     HASHMAP_T *m = (HASHMAP_T *) in;
-    int curr = __hashmap_hash_int(m, key);
-    HLIST_HEAD *list = &(m->list[curr]);
+    if(HASHMAP_IS_OPEN(m->type)) {
+        return __open_remove(m, key, data);
+    }
+    if(TUYA_HASHMAP_CONCURRENT == m->type) {
+        return __conc_remove(m, key, data);
+    }
+
+    uint32_t keylen = 0;
+    uint32_t hash = __hashmap_hash(key, &keylen);
+    HLIST_HEAD *list = &(m->list[hash & (m->table_size - 1)]);
 
     if(tuya_hlist_empty(list)) {
         return MAP_MISSING;
@@ -333,8 +1009,7 @@ int tuya_hashmap_remove(MAP_T in, char* key, ANY_T data)
     HLIST_NODE *pos = NULL;
     HASHMAP_ELEMENT_T *tmp_element = NULL;
     HLIST_FOR_EACH_ENTRY(tmp_element, HASHMAP_ELEMENT_T, pos, list, node) {
-        if(strlen(key) == strlen(tmp_element->key) && \
-           (strcmp(key,tmp_element->key) == 0)) {
+        if(__hashmap_key_equal(tmp_element, key, hash, keylen)) {
             if(  (NULL == data) || \
                  ((unsigned long)(tmp_element->data) == (unsigned long)data)) {
                 break;
@@ -342,12 +1017,13 @@ int tuya_hashmap_remove(MAP_T in, char* key, ANY_T data)
         }
     }
 
-    if(NULL == tmp_element) {
+    // the loop leaves tmp_element at the last entry when nothing matched
+    if(NULL == pos) {
         return MAP_MISSING;
     }
 
     __tuya_hlist_del(&(tmp_element->node));
-    tkl_system_free(tmp_element);
+    tuya_mem_pool_free(m->pool, tmp_element);
     m->size--;
 
     return MAP_OK;
@@ -363,9 +1039,24 @@ int tuya_hashmap_remove(MAP_T in, char* key, ANY_T data)
 void tuya_hashmap_free(MAP_T in)
 {
     HASHMAP_T* m = (HASHMAP_T*) in;
+    if(m->conc) {
+        __conc_release(m);
+    }
+    if(m->chunk) {
+        __arena_release(m);
+    }
+    if(m->pool) {
+        tuya_mem_pool_release(m->pool);
+    }
     if(m->list) {
         tkl_system_free(m->list);
     }
+    if(m->slots) {
+        tkl_system_free(m->slots);
+    }
+    if(m->old) {
+        tkl_system_free(m->old);
+    }
     tkl_system_free(m);
 
     return;
@@ -381,8 +1072,42 @@ int tuya_hashmap_length(MAP_T in)
 {
     HASHMAP_T* m = (HASHMAP_T *) in;
     if(m != NULL) 
-        return m->size;
+        return __atomic_load_n(&m->size, __ATOMIC_RELAXED);
     else 
         return 0;
 }
 
+
+/**
+ * @brief enter a read section of a concurrent hashmap
+ *
+ * @param[in] in the hashmap
+ * @return the token for tuya_hashmap_read_unlock
+ */
+uint32_t tuya_hashmap_read_lock(MAP_T in)
+{
+    HASHMAP_T* m = (HASHMAP_T *) in;
+
+    if(NULL == m || NULL == m->conc) {
+        return 0;
+    }
+
+    return __conc_read_lock(m->conc);
+}
+
+/**
+ * @brief leave a read section of a concurrent hashmap
+ *
+ * @param[in] in the hashmap
+ * @param[in] token what tuya_hashmap_read_lock returned
+ */
+void tuya_hashmap_read_unlock(MAP_T in, uint32_t token)
+{
+    HASHMAP_T* m = (HASHMAP_T *) in;
+
+    if(NULL == m || NULL == m->conc) {
+        return;
+    }
+
+    __conc_read_unlock(m->conc, token);
+}
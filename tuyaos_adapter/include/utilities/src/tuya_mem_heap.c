@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include "tuya_iot_config.h"
 #include "tuya_mem_heap.h"
@@ -28,6 +29,21 @@
 #endif
 #define FIT_FIND_DEPTH (3)
 
+#if MEM_ALIGN_NUM == 8
+#define MEM_ALIGN_LOG2 (3)
+#else
+#define MEM_ALIGN_LOG2 (2)
+#endif
+
+/* two-level segregated fit: 2^MEM_TLSF_SL_LOG2 linear lists per power of two */
+#define MEM_TLSF_SL_LOG2   (4)
+#define MEM_TLSF_SL_COUNT  (1 << MEM_TLSF_SL_LOG2)
+#define MEM_TLSF_FL_SHIFT  (MEM_TLSF_SL_LOG2 + MEM_ALIGN_LOG2)
+#define MEM_TLSF_FL_MAX    (32)
+#define MEM_TLSF_FL_COUNT  (MEM_TLSF_FL_MAX - MEM_TLSF_FL_SHIFT + 1)
+#define MEM_TLSF_SMALL_BLOCK (1UL << MEM_TLSF_FL_SHIFT)
+#define MEM_TLSF_REGION_SPARE (1)      // empty releasable regions kept before handing them back
+
 
 #if MEM_BLOCK_MIN_SIZE < MEM_ALIGN_NUM
 #error "MEM_BLOCK_MIN_SIZE < MEM_ALIGN_NUM"
@@ -39,13 +55,73 @@ typedef struct MEM_HeapBlock_s
 	struct MEM_HeapBlock_s * next;
 }MEM_HeapBlock_t;
 
+/*
+ * TLSF block, prev_phys is only valid while the previous block is free and
+ * overlaps the last word of its payload, so a used block costs one word.
+ */
+typedef struct MEM_TlsfBlock_s
+{
+	struct MEM_TlsfBlock_s * prev_phys;
+	unsigned long size;
+	struct MEM_TlsfBlock_s * next_free;
+	struct MEM_TlsfBlock_s * prev_free;
+}MEM_TlsfBlock_t;
+
+/*
+ * running block counters, kept where blocks enter and leave the free lists so
+ * reading them does not walk the heap. free_largest is only trusted while
+ * largest_stale is 0, it goes stale when the largest free block is taken.
+ */
+typedef struct
+{
+	unsigned long free_block;
+	unsigned long used_block;
+	unsigned long free_largest;
+	unsigned long largest_stale;
+	unsigned long free_hist[HEAP_FREE_HIST_NUM];
+}MEM_BlockStat_t;
+
+/*
+ * a TLSF heap manages one or more regions, each starts with this header and
+ * ends with a zero sized used block followed by a pointer back to the header.
+ * Nothing from clean up to the region end was ever handed out, so that part
+ * still reads zero if the region was given zeroed.
+ */
+typedef struct MEM_TlsfRegion_s
+{
+	struct MEM_TlsfRegion_s * next;
+	unsigned char * base;
+	unsigned long size;
+	MEM_TlsfBlock_t * first;
+	unsigned char * clean;
+	HEAP_REGION_RELEASE_CB release;
+}MEM_TlsfRegion_t;
+
+typedef struct
+{
+	MEM_TlsfRegion_t * regions;
+	MEM_BlockStat_t * stat;
+	MEM_TlsfBlock_t null_block;
+	unsigned int fl_bitmap;
+	unsigned int sl_bitmap[MEM_TLSF_FL_COUNT];
+	MEM_TlsfBlock_t * blocks[MEM_TLSF_FL_COUNT][MEM_TLSF_SL_COUNT];
+}MEM_TlsfCtrl_t;
+
 typedef struct
 {
 	MEM_HeapBlock_t  * free_list;
+	MEM_TlsfCtrl_t * tlsf;
 	unsigned char * base;
 	unsigned long size;
 	unsigned long free;
 	unsigned long free_watermark;
+	unsigned long realloc_fit;
+	unsigned long realloc_grow;
+	unsigned long realloc_shrink;
+	unsigned long realloc_move;
+	unsigned long calloc_skip;
+	MEM_BlockStat_t stat;
+	HEAP_ALGO_E algo;
 }MEM_Heap_t;
 
 typedef struct
@@ -90,12 +166,60 @@ typedef struct
 #define MEM_DOG_ADDR(block)  (( unsigned char* )block + block->size - 1 )
 #define MEM_LEAK_DBG_ADDR(block) ( MEM_DbgLeak_t* ) ( ( unsigned long )(intptr_t)block + block->size - sizeof(MEM_DbgLeak_t) - MEM_ALIGN_NUM)
 
+#define MEM_TLSF_FREE_BIT       (1UL << 0)
+#define MEM_TLSF_PREV_FREE_BIT  (1UL << 1)
+#define MEM_TLSF_SIZE_MASK      (~(MEM_TLSF_FREE_BIT | MEM_TLSF_PREV_FREE_BIT))
+#define MEM_TLSF_HEAD_SIZE      (sizeof(unsigned long))
+#define MEM_TLSF_START_OFFSET   (offsetof(MEM_TlsfBlock_t, size) + sizeof(unsigned long))
+#define MEM_TLSF_BLOCK_MIN      (sizeof(MEM_TlsfBlock_t) - sizeof(MEM_TlsfBlock_t *))
+#define MEM_TLSF_BLOCK_MAX      (1UL << (MEM_TLSF_FL_MAX - 1))
+
+#define MEM_TLSF_SIZE(block)     ( (block)->size & MEM_TLSF_SIZE_MASK )
+#define MEM_TLSF_IS_FREE(block)  ( (block)->size & MEM_TLSF_FREE_BIT )
+#define MEM_TLSF_TO_PTR(block)   ( ( void * ) ( ( unsigned char * ) (block) + MEM_TLSF_START_OFFSET ) )
+#define MEM_TLSF_FROM_PTR(ptr)   ( ( MEM_TlsfBlock_t * ) ( ( unsigned char * ) (ptr) - MEM_TLSF_START_OFFSET ) )
+#define MEM_TLSF_NEXT(block)     ( ( MEM_TlsfBlock_t * ) ( ( unsigned char * ) MEM_TLSF_TO_PTR(block) + MEM_TLSF_SIZE(block) - MEM_TLSF_HEAD_SIZE ) )
+#define MEM_TLSF_REGION_HEAD_SIZE ALIGN_UP ( sizeof ( MEM_TlsfRegion_t ) )
+#define MEM_TLSF_REGION_MIN_SIZE  ( MEM_TLSF_REGION_HEAD_SIZE + 4 * MEM_TLSF_HEAD_SIZE + MEM_TLSF_BLOCK_MIN )
+#define MEM_TLSF_REGION_OF(sentinel) ( * ( MEM_TlsfRegion_t ** ) MEM_TLSF_TO_PTR(sentinel) )
+#define MEM_TLSF_LEAK_DBG_ADDR(block) ( MEM_DbgLeak_t* ) ( ( unsigned char * ) MEM_TLSF_TO_PTR(block) + MEM_TLSF_SIZE(block) - sizeof(MEM_DbgLeak_t) )
+
+#define MEM_FFS(x) ( __builtin_ffs((int)(x)) - 1 )
+#define MEM_FLS(x) ( (x) ? (int)(sizeof(unsigned long) * 8) - 1 - __builtin_clzl((unsigned long)(x)) : -1 )
+
 static MEM_Heap_t mem_heap_list[MEM_HEAP_LIST_NUM] = {0};
 static unsigned long s_heap_free_size = 0;
 static unsigned long s_heap_free_size_watermark = 0; // minimum free size ever
 static heap_context_t s_heap_ctx;
 
-static int mem_heap_init ( MEM_Heap_t * heap, void * ptr, unsigned long size )
+static int mem_tlsf_init ( MEM_Heap_t * heap, void * ptr, unsigned long size );
+
+/* bucket n of the histogram counts the free blocks of 2^n up to 2^(n+1)-1 bytes */
+static void mem_stat_free_add ( MEM_BlockStat_t * stat, unsigned long size )
+{
+	int n = MEM_FLS ( size );
+
+	stat->free_block++;
+	stat->free_hist[n < HEAP_FREE_HIST_NUM ? n : HEAP_FREE_HIST_NUM - 1]++;
+	if ( !stat->largest_stale && size > stat->free_largest )
+	{
+		stat->free_largest = size;
+	}
+}
+
+static void mem_stat_free_del ( MEM_BlockStat_t * stat, unsigned long size )
+{
+	int n = MEM_FLS ( size );
+
+	stat->free_block--;
+	stat->free_hist[n < HEAP_FREE_HIST_NUM ? n : HEAP_FREE_HIST_NUM - 1]--;
+	if ( size == stat->free_largest )
+	{
+		stat->largest_stale = 1;
+	}
+}
+
+static int mem_heap_init ( MEM_Heap_t * heap, void * ptr, unsigned long size, HEAP_ALGO_E algo )
 {
 #if defined(MEM_DEBUG_FREE_FILL) && (MEM_DEBUG_FREE_FILL == 1)
 	memset(ptr, MEM_DEBUG_FILL_VAL, size);
@@ -103,6 +227,12 @@ static int mem_heap_init ( MEM_Heap_t * heap, void * ptr, unsigned long size )
 
 	heap->base = ptr;
 	heap->size = size;
+	heap->algo = algo;
+
+	if ( algo == HEAP_ALGO_TLSF )
+	{
+		return mem_tlsf_init ( heap, ptr, size );
+	}
 
 	ptr   = ( void * ) (intptr_t)ALIGN_UP ( (intptr_t)ptr );
 	size -= ( unsigned long ) (intptr_t)ptr - ( unsigned long ) (intptr_t)heap->base;
@@ -116,6 +246,7 @@ static int mem_heap_init ( MEM_Heap_t * heap, void * ptr, unsigned long size )
 	heap->free_list = ( MEM_HeapBlock_t * ) ptr;
 	heap->free_list->next = NULL;
 	heap->free_list->size  = size;
+	mem_stat_free_add ( &heap->stat, size );
 
     heap->free = size;
     heap->free_watermark = size;
@@ -174,9 +305,13 @@ static MEM_HeapBlock_t * mem_chunk_get ( MEM_Heap_t * heap, unsigned long size )
 			}
 #endif
 
+			mem_stat_free_del ( &heap->stat, this_block->size );
+			heap->stat.used_block++;
+
 			if ( ( this_block->size - size ) >= MEM_HEAP_MIN_SIZE )
 			{
 				this_block->size -= size;
+				mem_stat_free_add ( &heap->stat, this_block->size );
 
 				*MEM_DOG_ADDR ( this_block ) = MEM_BLOCK_STAT_FREE;
 				new_block = ( MEM_HeapBlock_t * ) (intptr_t)( ( unsigned long ) (intptr_t)this_block + this_block->size );
@@ -210,64 +345,734 @@ static MEM_HeapBlock_t * mem_chunk_get ( MEM_Heap_t * heap, unsigned long size )
 	return ( NULL );
 }
 
-static MEM_Heap_t *MEM_HeapCreate ( void*ptr, unsigned long size )
+/*
+ * two-level segregated fit engine
+ * every free block lives in the list selected by (fl, sl), the bitmaps give
+ * the first non-empty list large enough in constant time, and physical
+ * neighbours are reached through the block size and prev_phys link.
+ */
+static void mem_tlsf_mapping_insert ( unsigned long size, int * fl, int * sl )
+{
+	if ( size < MEM_TLSF_SMALL_BLOCK )
+	{
+		*fl = 0;
+		*sl = ( int ) ( size / ( MEM_TLSF_SMALL_BLOCK / MEM_TLSF_SL_COUNT ) );
+	}
+	else
+	{
+		int f = MEM_FLS ( size );
+		*sl = ( int ) ( size >> ( f - MEM_TLSF_SL_LOG2 ) ) ^ ( 1 << MEM_TLSF_SL_LOG2 );
+		*fl = f - ( MEM_TLSF_FL_SHIFT - 1 );
+	}
+}
+
+static void mem_tlsf_mapping_search ( unsigned long size, int * fl, int * sl )
+{
+	if ( size >= MEM_TLSF_SMALL_BLOCK )
+	{
+		size += ( 1UL << ( MEM_FLS ( size ) - MEM_TLSF_SL_LOG2 ) ) - 1;
+	}
+	mem_tlsf_mapping_insert ( size, fl, sl );
+}
+
+static MEM_TlsfBlock_t * mem_tlsf_search_suitable ( MEM_TlsfCtrl_t * ctrl, int * fl, int * sl )
+{
+	unsigned int sl_map;
+	unsigned int fl_map;
+
+	if ( *fl >= MEM_TLSF_FL_COUNT )
+	{
+		return NULL;
+	}
+
+	sl_map = ctrl->sl_bitmap[*fl] & ( ~0U << *sl );
+	if ( !sl_map )
+	{
+		fl_map = ( *fl + 1 >= MEM_TLSF_FL_COUNT ) ? 0 : ( ctrl->fl_bitmap & ( ~0U << ( *fl + 1 ) ) );
+		if ( !fl_map )
+		{
+			return NULL;
+		}
+
+		*fl = MEM_FFS ( fl_map );
+		sl_map = ctrl->sl_bitmap[*fl];
+	}
+
+	*sl = MEM_FFS ( sl_map );
+	return ctrl->blocks[*fl][*sl];
+}
+
+static void mem_tlsf_remove_free ( MEM_TlsfCtrl_t * ctrl, MEM_TlsfBlock_t * block, int fl, int sl )
+{
+	MEM_TlsfBlock_t * prev = block->prev_free;
+	MEM_TlsfBlock_t * next = block->next_free;
+
+	mem_stat_free_del ( ctrl->stat, MEM_TLSF_SIZE ( block ) );
+
+	next->prev_free = prev;
+	prev->next_free = next;
+
+	if ( ctrl->blocks[fl][sl] == block )
+	{
+		ctrl->blocks[fl][sl] = next;
+		if ( next == &ctrl->null_block )
+		{
+			ctrl->sl_bitmap[fl] &= ~( 1U << sl );
+			if ( !ctrl->sl_bitmap[fl] )
+			{
+				ctrl->fl_bitmap &= ~( 1U << fl );
+			}
+		}
+	}
+}
+
+static void mem_tlsf_insert_free ( MEM_TlsfCtrl_t * ctrl, MEM_TlsfBlock_t * block, int fl, int sl )
+{
+	MEM_TlsfBlock_t * current = ctrl->blocks[fl][sl];
+
+	mem_stat_free_add ( ctrl->stat, MEM_TLSF_SIZE ( block ) );
+	block->next_free = current;
+	block->prev_free = &ctrl->null_block;
+	current->prev_free = block;
+
+	ctrl->blocks[fl][sl] = block;
+	ctrl->fl_bitmap |= ( 1U << fl );
+	ctrl->sl_bitmap[fl] |= ( 1U << sl );
+}
+
+static void mem_tlsf_block_remove ( MEM_TlsfCtrl_t * ctrl, MEM_TlsfBlock_t * block )
+{
+	int fl, sl;
+
+	mem_tlsf_mapping_insert ( MEM_TLSF_SIZE ( block ), &fl, &sl );
+	mem_tlsf_remove_free ( ctrl, block, fl, sl );
+}
+
+static void mem_tlsf_block_insert ( MEM_TlsfCtrl_t * ctrl, MEM_TlsfBlock_t * block )
+{
+	int fl, sl;
+
+	mem_tlsf_mapping_insert ( MEM_TLSF_SIZE ( block ), &fl, &sl );
+	mem_tlsf_insert_free ( ctrl, block, fl, sl );
+}
+
+static MEM_TlsfBlock_t * mem_tlsf_link_next ( MEM_TlsfBlock_t * block )
+{
+	MEM_TlsfBlock_t * next = MEM_TLSF_NEXT ( block );
+
+	next->prev_phys = block;
+	return next;
+}
+
+static void mem_tlsf_mark_free ( MEM_TlsfBlock_t * block )
+{
+	MEM_TlsfBlock_t * next = mem_tlsf_link_next ( block );
+
+	next->size |= MEM_TLSF_PREV_FREE_BIT;
+	block->size |= MEM_TLSF_FREE_BIT;
+}
+
+static void mem_tlsf_mark_used ( MEM_TlsfBlock_t * block )
+{
+	MEM_TlsfBlock_t * next = MEM_TLSF_NEXT ( block );
+
+	next->size &= ~MEM_TLSF_PREV_FREE_BIT;
+	block->size &= ~MEM_TLSF_FREE_BIT;
+}
+
+/* cut block down to size and return the remaining tail as a free block */
+static MEM_TlsfBlock_t * mem_tlsf_split ( MEM_TlsfBlock_t * block, unsigned long size )
+{
+	MEM_TlsfBlock_t * remain = ( MEM_TlsfBlock_t * ) ( ( unsigned char * ) MEM_TLSF_TO_PTR ( block ) + size - MEM_TLSF_HEAD_SIZE );
+	unsigned long remain_size = MEM_TLSF_SIZE ( block ) - ( size + MEM_TLSF_HEAD_SIZE );
+
+	MEM_ASSERT ( remain_size >= MEM_TLSF_BLOCK_MIN );
+
+	remain->size = remain_size;
+	block->size = size | ( block->size & ~MEM_TLSF_SIZE_MASK );
+	mem_tlsf_mark_free ( remain );
+
+	return remain;
+}
+
+/* merge block into prev, both are physically adjacent */
+static MEM_TlsfBlock_t * mem_tlsf_absorb ( MEM_TlsfBlock_t * prev, MEM_TlsfBlock_t * block )
+{
+	prev->size += MEM_TLSF_SIZE ( block ) + MEM_TLSF_HEAD_SIZE;
+	mem_tlsf_link_next ( prev );
+	return prev;
+}
+
+static MEM_TlsfBlock_t * mem_tlsf_merge_prev ( MEM_TlsfCtrl_t * ctrl, MEM_TlsfBlock_t * block )
+{
+	if ( block->size & MEM_TLSF_PREV_FREE_BIT )
+	{
+		MEM_TlsfBlock_t * prev = block->prev_phys;
+
+		MEM_ASSERT ( MEM_TLSF_IS_FREE ( prev ) );
+		mem_tlsf_block_remove ( ctrl, prev );
+		block = mem_tlsf_absorb ( prev, block );
+	}
+
+	return block;
+}
+
+static MEM_TlsfBlock_t * mem_tlsf_merge_next ( MEM_TlsfCtrl_t * ctrl, MEM_TlsfBlock_t * block )
+{
+	MEM_TlsfBlock_t * next = MEM_TLSF_NEXT ( block );
+
+	if ( MEM_TLSF_IS_FREE ( next ) )
+	{
+		mem_tlsf_block_remove ( ctrl, next );
+		block = mem_tlsf_absorb ( block, next );
+	}
+
+	return block;
+}
+
+static unsigned long mem_tlsf_adjust_size ( unsigned long size )
+{
+	unsigned long adjust;
+
+	if ( size == 0 || size > MEM_TLSF_BLOCK_MAX )
+	{
+		return 0;
+	}
+
+	adjust = ALIGN_UP ( size );
+	return adjust < MEM_TLSF_BLOCK_MIN ? MEM_TLSF_BLOCK_MIN : adjust;
+}
+
+static void mem_tlsf_add_region ( MEM_TlsfCtrl_t * ctrl, void * ptr, unsigned long size )
+{
+	MEM_TlsfBlock_t * block = ( MEM_TlsfBlock_t * ) ptr;
+	MEM_TlsfBlock_t * next;
+
+	/* first block owns the whole region, a zero sized used block closes it */
+	block->size = size | MEM_TLSF_FREE_BIT;
+	mem_tlsf_block_insert ( ctrl, block );
+
+	next = mem_tlsf_link_next ( block );
+	next->size = MEM_TLSF_PREV_FREE_BIT;
+}
+
+/* put a region header at ptr and hand the rest to TLSF, returns the free bytes added */
+static unsigned long mem_tlsf_region_add ( MEM_TlsfCtrl_t * ctrl, void * ptr, unsigned long size, int zeroed, HEAP_REGION_RELEASE_CB release )
+{
+	MEM_TlsfRegion_t * region;
+	unsigned char * base = ptr;
+	unsigned long pool_size;
+
+	ptr = ( void * ) (intptr_t)ALIGN_UP ( (intptr_t)ptr );
+	pool_size = ALIGN_DOWN ( size - ( ( unsigned long ) (intptr_t)ptr - ( unsigned long ) (intptr_t)base ) );
+
+	/* region header, first block header, the closing sentinel and its back pointer */
+	if ( size < MEM_ALIGN_NUM || pool_size < MEM_TLSF_REGION_MIN_SIZE )
+	{
+		return 0;
+	}
+
+	pool_size -= MEM_TLSF_REGION_HEAD_SIZE + 4 * MEM_TLSF_HEAD_SIZE;
+	if ( pool_size > MEM_TLSF_BLOCK_MAX )
+	{
+		pool_size = MEM_TLSF_BLOCK_MAX;
+	}
+
+	region = ( MEM_TlsfRegion_t * ) ptr;
+	region->base = base;
+	region->size = size;
+	region->release = release;
+	region->first = ( MEM_TlsfBlock_t * ) ( ( unsigned char * ) ptr + MEM_TLSF_REGION_HEAD_SIZE );
+	region->next = ctrl->regions;
+	ctrl->regions = region;
+
+	mem_tlsf_add_region ( ctrl, region->first, pool_size );
+	MEM_TLSF_REGION_OF ( MEM_TLSF_NEXT ( region->first ) ) = region;
+	region->clean = zeroed ? ( unsigned char * ) MEM_TLSF_TO_PTR ( region->first ) : base + size;
+
+	return pool_size + MEM_TLSF_HEAD_SIZE;
+}
+
+/* the region is empty when its first block is free and reaches the closing sentinel */
+static int mem_tlsf_region_empty ( MEM_TlsfRegion_t * region )
+{
+	return MEM_TLSF_IS_FREE ( region->first ) && ( MEM_TLSF_SIZE ( MEM_TLSF_NEXT ( region->first ) ) == 0 );
+}
+
+/*
+ * block is free, merged and reaches the end of its region. If it is the whole of
+ * a releasable region and enough spare regions are left, unlink the region so the
+ * caller can hand it back once out of the critical section.
+ */
+static MEM_TlsfRegion_t * mem_tlsf_region_take ( MEM_Heap_t * heap, MEM_TlsfBlock_t * block )
+{
+	MEM_TlsfRegion_t ** link;
+	MEM_TlsfRegion_t * region = MEM_TLSF_REGION_OF ( MEM_TLSF_NEXT ( block ) );
+	MEM_TlsfRegion_t ** found = NULL;
+	unsigned long spare = 0;
+
+	if ( region->first != block || region->release == NULL )
+	{
+		return NULL;
+	}
+
+	for ( link = &heap->tlsf->regions; *link; link = &( *link )->next )
+	{
+		if ( *link == region )
+		{
+			found = link;
+		}
+		else if ( ( *link )->release && mem_tlsf_region_empty ( *link ) )
+		{
+			spare++;
+		}
+	}
+
+	if ( found == NULL || spare < MEM_TLSF_REGION_SPARE )
+	{
+		return NULL;
+	}
+
+	region = *found;
+	*found = region->next;
+	region->next = NULL;
+
+	heap->size -= region->size;
+	heap->free -= MEM_TLSF_SIZE ( block ) + MEM_TLSF_HEAD_SIZE;
+	s_heap_free_size -= MEM_TLSF_SIZE ( block ) + MEM_TLSF_HEAD_SIZE;
+
+	return region;
+}
+
+static void mem_tlsf_region_release ( MEM_TlsfRegion_t * region )
+{
+	MEM_TlsfRegion_t * next;
+
+	while ( region )
+	{
+		next = region->next;
+		region->release ( region->base, region->size );
+		region = next;
+	}
+}
+
+static int mem_tlsf_init ( MEM_Heap_t * heap, void * ptr, unsigned long size )
+{
+	MEM_TlsfCtrl_t * ctrl;
+	unsigned long ctrl_size = ALIGN_UP ( sizeof ( MEM_TlsfCtrl_t ) );
+	int i, j;
+
+	ptr = ( void * ) (intptr_t)ALIGN_UP ( (intptr_t)ptr );
+	size -= ( unsigned long ) (intptr_t)ptr - ( unsigned long ) (intptr_t)heap->base;
+	size = ALIGN_DOWN ( size );
+
+	/* control block followed by the first region */
+	if ( size < ctrl_size + MEM_TLSF_REGION_MIN_SIZE )
+	{
+		return -1;
+	}
+
+	ctrl = ( MEM_TlsfCtrl_t * ) ptr;
+	memset ( ctrl, 0, sizeof ( MEM_TlsfCtrl_t ) );
+	ctrl->stat = &heap->stat;
+	ctrl->null_block.next_free = &ctrl->null_block;
+	ctrl->null_block.prev_free = &ctrl->null_block;
+	for ( i = 0; i < MEM_TLSF_FL_COUNT; i++ )
+	{
+		for ( j = 0; j < MEM_TLSF_SL_COUNT; j++ )
+		{
+			ctrl->blocks[i][j] = &ctrl->null_block;
+		}
+	}
+
+	heap->tlsf = ctrl;
+	heap->free_list = NULL;
+	heap->free = mem_tlsf_region_add ( ctrl, ( unsigned char * ) ptr + ctrl_size, size - ctrl_size, 0, NULL );
+	heap->free_watermark = heap->free;
+	s_heap_free_size += heap->free;
+	s_heap_free_size_watermark = s_heap_free_size;
+
+	return 0;
+}
+
+/*
+ * raise the clean mark of the region over a block handed out and over the header
+ * and free list links of the block split off behind it, returns the old mark
+ */
+static unsigned char * mem_tlsf_region_use ( MEM_TlsfRegion_t * region, MEM_TlsfBlock_t * block )
+{
+	unsigned char * clean = region->clean;
+	unsigned char * end = ( unsigned char * ) MEM_TLSF_TO_PTR ( block ) + MEM_TLSF_SIZE ( block ) + MEM_TLSF_BLOCK_MIN;
+
+	if ( end > clean )
+	{
+		region->clean = end;
+	}
+
+	return clean;
+}
+
+/* give the front of a free block back so the payload of the rest is aligned */
+static MEM_TlsfBlock_t * mem_tlsf_trim_leading ( MEM_TlsfCtrl_t * ctrl, MEM_TlsfBlock_t * block, unsigned long align )
+{
+	unsigned long ptr = ( unsigned long ) (intptr_t)MEM_TLSF_TO_PTR ( block );
+	unsigned long gap = ( ( ptr + align - 1 ) & ~( align - 1 ) ) - ptr;
+	MEM_TlsfBlock_t * remain;
+
+	if ( gap == 0 )
+	{
+		return block;
+	}
+
+	/* the front has to be a free block of its own */
+	if ( gap < sizeof ( MEM_TlsfBlock_t ) )
+	{
+		gap = ( ( ptr + sizeof ( MEM_TlsfBlock_t ) + align - 1 ) & ~( align - 1 ) ) - ptr;
+	}
+
+	remain = mem_tlsf_split ( block, gap - MEM_TLSF_HEAD_SIZE );
+	remain->size |= MEM_TLSF_PREV_FREE_BIT;
+	mem_tlsf_link_next ( block );
+	mem_tlsf_block_insert ( ctrl, block );
+
+	return remain;
+}
+
+/*
+ * clean tells from where on the block still reads zero, NULL if it may not be
+ * zero at all. Only the last block of a region can reach above the clean mark.
+ * An align above MEM_ALIGN_NUM asks for a block big enough to cut the payload
+ * out at that alignment.
+ */
+static MEM_TlsfBlock_t * mem_tlsf_chunk_get ( MEM_Heap_t * heap, unsigned long size, unsigned long align, unsigned char ** clean )
+{
+	MEM_TlsfCtrl_t * ctrl = heap->tlsf;
+	MEM_TlsfBlock_t * block;
+	MEM_TlsfBlock_t * next;
+	unsigned long search = size;
+	int fl, sl;
+
+	if ( align > MEM_ALIGN_NUM )
+	{
+		search = mem_tlsf_adjust_size ( size + align + sizeof ( MEM_TlsfBlock_t ) );
+		if ( search == 0 )
+		{
+			return NULL;
+		}
+	}
+
+	mem_tlsf_mapping_search ( search, &fl, &sl );
+	block = mem_tlsf_search_suitable ( ctrl, &fl, &sl );
+	if ( block == NULL || block == &ctrl->null_block )
+	{
+		return NULL;
+	}
+
+	MEM_ASSERT ( MEM_TLSF_SIZE ( block ) >= search );
+	mem_tlsf_remove_free ( ctrl, block, fl, sl );
+	next = MEM_TLSF_NEXT ( block );
+
+	if ( align > MEM_ALIGN_NUM )
+	{
+		block = mem_tlsf_trim_leading ( ctrl, block, align );
+	}
+
+	if ( MEM_TLSF_SIZE ( block ) >= size + sizeof ( MEM_TlsfBlock_t ) )
+	{
+		MEM_TlsfBlock_t * remain = mem_tlsf_split ( block, size );
+		mem_tlsf_block_insert ( ctrl, remain );
+	}
+
+	mem_tlsf_mark_used ( block );
+	ctrl->stat->used_block++;
+
+	if ( MEM_TLSF_SIZE ( next ) == 0 )
+	{
+		unsigned char * mark = mem_tlsf_region_use ( MEM_TLSF_REGION_OF ( next ), block );
+		if ( clean )
+		{
+			*clean = mark;
+		}
+	}
+	else if ( clean )
+	{
+		*clean = NULL;
+	}
+
+	return block;
+}
+
+/* returns the region to hand back if the block emptied it */
+static MEM_TlsfRegion_t * mem_tlsf_chunk_put ( MEM_Heap_t * heap, MEM_TlsfBlock_t * block )
+{
+	MEM_TlsfCtrl_t * ctrl = heap->tlsf;
+	MEM_TlsfRegion_t * region = NULL;
+
+	mem_tlsf_mark_free ( block );
+	ctrl->stat->used_block--;
+	block = mem_tlsf_merge_prev ( ctrl, block );
+	block = mem_tlsf_merge_next ( ctrl, block );
+
+	if ( MEM_TLSF_SIZE ( MEM_TLSF_NEXT ( block ) ) == 0 )
+	{
+		region = mem_tlsf_region_take ( heap, block );
+	}
+
+	if ( region == NULL )
+	{
+		mem_tlsf_block_insert ( ctrl, block );
+	}
+
+	return region;
+}
+
+static MEM_Heap_t *MEM_HeapCreate ( void*ptr, unsigned long size, HEAP_ALGO_E algo )
 {
 	MEM_Heap_t * heap = NULL;
 	long i;
 
-	if ( ptr == NULL || size == 0 )
+	if ( ptr == NULL || size == 0 )
+	{
+		s_heap_ctx.dbg_output ( "[MEM DBG] MEM_HeapCreate params err\r\n" );
+		return NULL;
+	}
+
+	s_heap_ctx.enter_critical();
+	for ( i = 0;i < MEM_HEAP_LIST_NUM;i++ )
+	{
+		if ( mem_heap_list[i].size == 0 )
+		{
+			break;
+		}
+	}
+
+	if ( i < MEM_HEAP_LIST_NUM )
+	{
+		heap = &mem_heap_list[i];
+		if ( mem_heap_init ( heap, ptr, size, algo ) != 0 )
+		{
+			heap->size = 0;
+			heap = NULL;
+		}
+	}
+	s_heap_ctx.exit_critical();
+	
+	return heap;
+}
+
+static void MEM_HeapDelete ( MEM_Heap_t*heap )
+{
+	long i = 0;
+
+	if ( heap == NULL )
+	{
+		s_heap_ctx.dbg_output ( "[MEM DBG] MEM_HeapDelete params err\r\n" );
+		return ;
+	}
+
+	s_heap_ctx.enter_critical();
+	for ( i = 0;i < MEM_HEAP_LIST_NUM;i++ )
+	{
+		if ( heap == &mem_heap_list[i] )
+		{
+			break;
+		}
+	}
+
+	if ( i < MEM_HEAP_LIST_NUM )
+	{
+		memset ( heap, 0, sizeof ( MEM_Heap_t ) );
+	}
+	s_heap_ctx.exit_critical();
+}
+
+static void MEM_HeapUsed ( MEM_Heap_t * heap, unsigned long size )
+{
+	heap->free -= size;
+	if ( heap->free_watermark > heap->free )
+	{
+		heap->free_watermark = heap->free;
+	}
+
+	s_heap_free_size -= size;
+	if ( s_heap_free_size_watermark > s_heap_free_size )
+	{
+		s_heap_free_size_watermark = s_heap_free_size;
+	}
+}
+
+/*
+ * allocate a block, with zero set clear its first size bytes. Bytes from the
+ * clean mark on are zero already except the free list links TLSF kept at the
+ * start of the block and the back link of the next block in its last word.
+ */
+static void * MEM_TlsfAllocate ( MEM_Heap_t * heap, unsigned long size, unsigned long align, int zero )
+{
+	MEM_TlsfBlock_t * block;
+	unsigned char * ptr;
+	unsigned char * clean = NULL;
+	unsigned long adjust = mem_tlsf_adjust_size ( size );
+	unsigned long head = size;
+	unsigned long tail = size;
+
+	if ( adjust == 0 )
+	{
+		return NULL;
+	}
+
+	s_heap_ctx.enter_critical();
+	block = mem_tlsf_chunk_get ( heap, adjust, align, zero ? &clean : NULL );
+	if ( block )
+	{
+		MEM_HeapUsed ( heap, MEM_TLSF_SIZE ( block ) + MEM_TLSF_HEAD_SIZE );
+
+		ptr = MEM_TLSF_TO_PTR ( block );
+		if ( clean && clean < ptr + size )
+		{
+			head = clean > ptr ? ( unsigned long ) ( clean - ptr ) : 0;
+			head = head < 2 * sizeof ( void * ) ? 2 * sizeof ( void * ) : head;
+			tail = MEM_TLSF_SIZE ( block ) - sizeof ( void * );
+			if ( head < size && tail > head )
+			{
+				heap->calloc_skip += ( tail < size ? tail : size ) - head;
+			}
+		}
+	}
+	s_heap_ctx.exit_critical();
+
+	if ( block == NULL )
 	{
-		s_heap_ctx.dbg_output ( "[MEM DBG] MEM_HeapCreate params err\r\n" );
 		return NULL;
 	}
 
-	s_heap_ctx.enter_critical();
-	for ( i = 0;i < MEM_HEAP_LIST_NUM;i++ )
+	if ( zero )
 	{
-		if ( mem_heap_list[i].size == 0 )
+		memset ( ptr, 0, head < size ? head : size );
+		if ( tail < size )
 		{
-			break;
+			memset ( ptr + tail, 0, size - tail );
 		}
 	}
 
-	if ( i < MEM_HEAP_LIST_NUM )
+	return ptr;
+}
+
+static void MEM_TlsfDeallocate ( MEM_Heap_t * heap, void * ptr )
+{
+	MEM_TlsfBlock_t * block = MEM_TLSF_FROM_PTR ( ptr );
+	MEM_TlsfRegion_t * region;
+
+	/* the flag bits of a used block are changed by its neighbours, check them locked */
+	s_heap_ctx.enter_critical();
+	if ( MEM_TLSF_IS_FREE ( block ) )
 	{
-		heap = &mem_heap_list[i];
-		if ( mem_heap_init ( heap, ptr, size ) != 0 )
-		{
-			heap->size = 0;
-			heap = NULL;
-		}
+		s_heap_ctx.exit_critical();
+		s_heap_ctx.dbg_output ( "[MEM DBG] mem %p might be freed yet\r\n", ptr );
+		return;
 	}
+
+#if defined(MEM_DEBUG_FREE_FILL) && (MEM_DEBUG_FREE_FILL == 1)
+	memset ( ptr, MEM_DEBUG_FILL_VAL, MEM_TLSF_SIZE ( block ) );
+#endif
+
+	heap->free += MEM_TLSF_SIZE ( block ) + MEM_TLSF_HEAD_SIZE;
+	s_heap_free_size += MEM_TLSF_SIZE ( block ) + MEM_TLSF_HEAD_SIZE;
+	region = mem_tlsf_chunk_put ( heap, block );
 	s_heap_ctx.exit_critical();
-	
-	return heap;
+
+	mem_tlsf_region_release ( region );
 }
 
-static void MEM_HeapDelete ( MEM_Heap_t*heap )
+/*
+ * resize a used block without moving it: grow into the next block if it is free
+ * and big enough, give the tail back if it is worth a block. Returns 0 when done,
+ * -1 when the block has to move.
+ */
+static int MEM_TlsfResize ( MEM_Heap_t * heap, void * ptr, unsigned long size )
 {
-	long i = 0;
-
-	if ( heap == NULL )
+	MEM_TlsfBlock_t * block = MEM_TLSF_FROM_PTR ( ptr );
+	MEM_TlsfBlock_t * next;
+	MEM_TlsfBlock_t * remain;
+	unsigned long adjust = mem_tlsf_adjust_size ( size );
+	unsigned long cur;
+	int ret = 0;
+
+	if ( adjust == 0 )
 	{
-		s_heap_ctx.dbg_output ( "[MEM DBG] MEM_HeapDelete params err\r\n" );
-		return ;
+		return -1;
 	}
 
 	s_heap_ctx.enter_critical();
-	for ( i = 0;i < MEM_HEAP_LIST_NUM;i++ )
+	cur = MEM_TLSF_SIZE ( block );
+	next = MEM_TLSF_NEXT ( block );
+
+	if ( adjust > cur )
 	{
-		if ( heap == &mem_heap_list[i] )
+		if ( !MEM_TLSF_IS_FREE ( next ) || cur + MEM_TLSF_SIZE ( next ) + MEM_TLSF_HEAD_SIZE < adjust )
 		{
-			break;
+			ret = -1;
+			goto EXIT;
+		}
+
+		mem_tlsf_block_remove ( heap->tlsf, next );
+		block = mem_tlsf_absorb ( block, next );
+		mem_tlsf_mark_used ( block );
+		next = MEM_TLSF_NEXT ( block );
+
+		if ( MEM_TLSF_SIZE ( block ) >= adjust + sizeof ( MEM_TlsfBlock_t ) )
+		{
+			remain = mem_tlsf_split ( block, adjust );
+			mem_tlsf_block_insert ( heap->tlsf, remain );
+		}
+
+		if ( MEM_TLSF_SIZE ( next ) == 0 )
+		{
+			mem_tlsf_region_use ( MEM_TLSF_REGION_OF ( next ), block );
 		}
+
+		MEM_HeapUsed ( heap, MEM_TLSF_SIZE ( block ) - cur );
+		heap->realloc_grow++;
 	}
+	else if ( cur >= adjust + sizeof ( MEM_TlsfBlock_t ) )
+	{
+		remain = mem_tlsf_split ( block, adjust );
+		remain = mem_tlsf_merge_next ( heap->tlsf, remain );
+		mem_tlsf_block_insert ( heap->tlsf, remain );
 
-	if ( i < MEM_HEAP_LIST_NUM )
+		heap->free += cur - MEM_TLSF_SIZE ( block );
+		s_heap_free_size += cur - MEM_TLSF_SIZE ( block );
+		heap->realloc_shrink++;
+	}
+	else
 	{
-		memset ( heap, 0, sizeof ( MEM_Heap_t ) );
+		heap->realloc_fit++;
 	}
+
+EXIT:
 	s_heap_ctx.exit_critical();
+
+	return ret;
+}
+
+/* usable bytes behind ptr, 0 if ptr is not an allocated block */
+static unsigned long MEM_UsableSize ( MEM_Heap_t * heap, void * ptr )
+{
+	if ( heap->algo == HEAP_ALGO_TLSF )
+	{
+		MEM_TlsfBlock_t * block = MEM_TLSF_FROM_PTR ( ptr );
+		unsigned long size;
+
+		s_heap_ctx.enter_critical();
+		size = MEM_TLSF_IS_FREE ( block ) ? 0 : MEM_TLSF_SIZE ( block );
+		s_heap_ctx.exit_critical();
+
+		return size;
+	}
+	else
+	{
+		MEM_HeapBlock_t * block = ( MEM_HeapBlock_t * ) ( ( unsigned long ) (intptr_t)ptr - MEM_BLOCK_HEAD_SIZE );
+		return ( *MEM_DOG_ADDR ( block ) != MEM_BLOCK_STAT_USE ) ? 0 : block->size - MEM_BLOCK_HEAD_SIZE - 1;
+	}
 }
 
 static void * MEM_Allocate ( MEM_Heap_t * heap, unsigned long size)
@@ -280,7 +1085,13 @@ static void * MEM_Allocate ( MEM_Heap_t * heap, unsigned long size)
 		return ( NULL );
 	}
 
-	size = size < 4 ? 4 : size;
+	if ( heap->algo == HEAP_ALGO_TLSF )
+	{
+		return MEM_TlsfAllocate ( heap, size, 0, 0 );
+	}
+
+	/* a freed block keeps its list link in front of the dog byte */
+	size = size < sizeof ( MEM_HeapBlock_t * ) ? sizeof ( MEM_HeapBlock_t * ) : size;
 
 	new_size = ALIGN_UP ( size + 1 ) + MEM_BLOCK_HEAD_SIZE;
 	if ( new_size < size )
@@ -324,7 +1135,14 @@ static void * MEM_AllocateDebug ( MEM_Heap_t * heap, unsigned long size , char*
 		block = ( MEM_HeapBlock_t* ) ( ( unsigned long ) (intptr_t)p - MEM_BLOCK_HEAD_SIZE );
 
 		/*得到保存调试信息的地址*/
-		leak = MEM_LEAK_DBG_ADDR ( block );
+		if ( heap->algo == HEAP_ALGO_TLSF )
+		{
+			leak = MEM_TLSF_LEAK_DBG_ADDR ( MEM_TLSF_FROM_PTR ( p ) );
+		}
+		else
+		{
+			leak = MEM_LEAK_DBG_ADDR ( block );
+		}
 		leak->filename = filename;
 		leak->line = line;
 		leak->size = size;
@@ -346,6 +1164,12 @@ static void MEM_Deallocate ( MEM_Heap_t * heap, void*ptr)
 		return ;
 	}
 
+	if ( heap->algo == HEAP_ALGO_TLSF )
+	{
+		MEM_TlsfDeallocate ( heap, ptr );
+		return;
+	}
+
 	free_block = ( MEM_HeapBlock_t * ) ( ( unsigned long ) (intptr_t)ptr - MEM_BLOCK_HEAD_SIZE );
 
 	pdog = MEM_DOG_ADDR ( free_block );
@@ -375,6 +1199,7 @@ static void MEM_Deallocate ( MEM_Heap_t * heap, void*ptr)
 
 	heap->free += free_block->size;
 	s_heap_free_size += free_block->size;
+	heap->stat.used_block--;
 
 	next_block = heap->free_list;
 	pre_block = NULL;
@@ -406,6 +1231,7 @@ static void MEM_Deallocate ( MEM_Heap_t * heap, void*ptr)
             *MEM_DOG_ADDR ( pre_block ) = MEM_DEBUG_FILL_VAL;
 #endif
 
+			mem_stat_free_del ( &heap->stat, pre_block->size );
 			pre_block->size += free_block->size;
 
 #if defined(MEM_DEBUG_FREE_FILL) && (MEM_DEBUG_FREE_FILL == 1)
@@ -426,6 +1252,7 @@ static void MEM_Deallocate ( MEM_Heap_t * heap, void*ptr)
 #if defined(MEM_DEBUG_FREE_FILL) && (MEM_DEBUG_FREE_FILL == 1)
             *MEM_DOG_ADDR ( pre_block ) = MEM_DEBUG_FILL_VAL;
 #endif
+			mem_stat_free_del ( &heap->stat, next_block->size );
 			pre_block->size  += next_block->size;
 			pre_block->next  = next_block->next;
 
@@ -434,7 +1261,87 @@ static void MEM_Deallocate ( MEM_Heap_t * heap, void*ptr)
 #endif
 		}
 	}
+
+	/* pre_block is the free block the freed one ended up in */
+	mem_stat_free_add ( &heap->stat, pre_block->size );
+	s_heap_ctx.exit_critical();
+}
+
+static void MEM_TlsfStatus ( MEM_Heap_t * heap, MEM_HeapStatus_t * status )
+{
+	MEM_TlsfRegion_t * region;
+	MEM_TlsfBlock_t * block = NULL;
+	MEM_TlsfBlock_t * prev;
+	MEM_DbgLeak_t * leak;
+	unsigned long this_size;
+	unsigned long top_addr;
+	unsigned long result = 0;
+
+	s_heap_ctx.enter_critical();
+
+	for ( region = heap->tlsf->regions; region; region = region->next )
+	{
+		prev = NULL;
+		block = region->first;
+		top_addr = ALIGN_DOWN ( (intptr_t)region->base + region->size );
+		while ( MEM_TLSF_SIZE ( block ) )
+		{
+			this_size = MEM_TLSF_SIZE ( block );
+			if ( ( unsigned long ) (intptr_t)block + MEM_TLSF_START_OFFSET + this_size > top_addr )
+			{
+				result = 3;
+				goto EXIT;
+			}
+
+			/* prev free flag must match the previous block, free blocks are always merged */
+			if ( ( ( block->size & MEM_TLSF_PREV_FREE_BIT ) != 0 ) != ( prev != NULL && MEM_TLSF_IS_FREE ( prev ) ) )
+			{
+				result = 2;
+				goto EXIT;
+			}
+
+			if ( MEM_TLSF_IS_FREE ( block ) )
+			{
+				if ( prev != NULL && MEM_TLSF_IS_FREE ( prev ) )
+				{
+					result = 1;
+					goto EXIT;
+				}
+
+				status->free += this_size;
+				if ( this_size > status->free_largest )
+				{
+					status->free_largest = this_size;
+				}
+				status->free_block++;
+			}
+			else
+			{
+				leak = MEM_TLSF_LEAK_DBG_ADDR ( block );
+				if ( this_size >= sizeof ( MEM_DbgLeak_t ) && leak->magic == MEM_DBG_LEAK_MAGIC )
+				{
+					s_heap_ctx.exit_critical();
+					s_heap_ctx.dbg_output ( "[MEM DBG] [mem use] %s:%d, addr=%p, size=%d\r\n",leak->filename, leak->line, block,leak->size );
+					s_heap_ctx.enter_critical();
+				}
+
+				status->used_block++;
+			}
+
+			prev = block;
+			block = MEM_TLSF_NEXT ( block );
+		}
+	}
+
+	status->valid = 1;
+
+EXIT:
 	s_heap_ctx.exit_critical();
+
+	if ( 0 != result )
+	{
+		s_heap_ctx.dbg_output ( "[MEM DBG] [ERROR]tlsf block damaged(%d),addr=%p,size=%d\r\n", result, block, MEM_TLSF_SIZE ( block ) );
+	}
 }
 
 static void  MEM_HeapStatus ( MEM_Heap_t * heap, MEM_HeapStatus_t * status )
@@ -455,6 +1362,12 @@ static void  MEM_HeapStatus ( MEM_Heap_t * heap, MEM_HeapStatus_t * status )
 	memset(status, 0, sizeof(MEM_HeapStatus_t));
 	status->size         = heap->size;
 
+	if ( heap->algo == HEAP_ALGO_TLSF )
+	{
+		MEM_TlsfStatus ( heap, status );
+		return;
+	}
+
 	addr       = ALIGN_UP ( (intptr_t)heap->base );
 	top_addr   = ALIGN_DOWN ( (intptr_t)heap->base + heap->size );
 
@@ -542,6 +1455,124 @@ EXIT:
     }
 }
 
+/*
+ * usable size of the largest free block, called locked. TLSF looks at the top
+ * non-empty list only, first fit walks its free list when the block counted
+ * last was taken.
+ */
+static unsigned long MEM_HeapLargest ( MEM_Heap_t * heap )
+{
+	MEM_BlockStat_t * stat = &heap->stat;
+	MEM_HeapBlock_t * free_block;
+	MEM_TlsfBlock_t * block;
+	MEM_TlsfCtrl_t * ctrl;
+	unsigned long largest = 0;
+	int fl, sl;
+
+	if ( heap->algo == HEAP_ALGO_TLSF )
+	{
+		ctrl = heap->tlsf;
+		if ( ctrl->fl_bitmap == 0 )
+		{
+			return 0;
+		}
+
+		fl = MEM_FLS ( ctrl->fl_bitmap );
+		sl = MEM_FLS ( ctrl->sl_bitmap[fl] );
+		for ( block = ctrl->blocks[fl][sl]; block != &ctrl->null_block; block = block->next_free )
+		{
+			if ( MEM_TLSF_SIZE ( block ) > largest )
+			{
+				largest = MEM_TLSF_SIZE ( block );
+			}
+		}
+
+		return largest;
+	}
+
+	if ( stat->largest_stale )
+	{
+		stat->free_largest = 0;
+		for ( free_block = heap->free_list; free_block; free_block = free_block->next )
+		{
+			if ( free_block->size > stat->free_largest )
+			{
+				stat->free_largest = free_block->size;
+			}
+		}
+		stat->largest_stale = 0;
+	}
+
+	return stat->free_largest ? stat->free_largest - MEM_BLOCK_HEAD_SIZE - 1 : 0;
+}
+
+static void MEM_HeapState ( MEM_Heap_t * heap, heap_state_t * state )
+{
+	unsigned long largest;
+	int i;
+
+	state->total_size += heap->size;
+	state->realloc_fit += heap->realloc_fit;
+	state->realloc_grow += heap->realloc_grow;
+	state->realloc_shrink += heap->realloc_shrink;
+	state->realloc_move += heap->realloc_move;
+	state->calloc_skip += heap->calloc_skip;
+
+	s_heap_ctx.enter_critical();
+	largest = MEM_HeapLargest ( heap );
+	state->free_block_num += heap->stat.free_block;
+	state->used_block_num += heap->stat.used_block;
+	for ( i = 0; i < HEAP_FREE_HIST_NUM; i++ )
+	{
+		state->free_hist[i] += heap->stat.free_hist[i];
+	}
+	s_heap_ctx.exit_critical();
+
+	if ( largest > state->max_free_block_size )
+	{
+		state->max_free_block_size = largest;
+	}
+}
+
+static MEM_Heap_t * MEM_HeapFind ( HEAP_HANDLE handle, void * ptr )
+{
+	long idx;
+	MEM_Heap_t * pHeap;
+
+	if ( 0 != handle )
+	{
+		return ( MEM_Heap_t * ) handle;
+	}
+
+	for ( idx = 0 ; idx < MEM_HEAP_LIST_NUM ; idx ++ )
+	{
+		pHeap = &mem_heap_list[idx];
+		if ( pHeap->size == 0 )
+		{
+			break;
+		}
+
+		if ( pHeap->algo == HEAP_ALGO_TLSF )
+		{
+			MEM_TlsfRegion_t * region;
+
+			for ( region = pHeap->tlsf->regions; region; region = region->next )
+			{
+				if ( ( ( unsigned char * ) ptr > region->base ) && ( ( unsigned char * ) ptr < ( region->base + region->size ) ) )
+				{
+					return pHeap;
+				}
+			}
+		}
+		else if ( ( ( unsigned char * ) ptr > pHeap->base ) && ( ( unsigned char * ) ptr < ( pHeap->base + pHeap->size ) ) )
+		{
+			return pHeap;
+		}
+	}
+
+	return NULL;
+}
+
 int tuya_mem_heap_init(heap_context_t *ctx)
 {
     if((NULL == ctx) || (NULL == ctx->enter_critical) ||
@@ -557,12 +1588,17 @@ int tuya_mem_heap_init(heap_context_t *ctx)
 }
 
 int tuya_mem_heap_create(void *start_addr, unsigned int size, HEAP_HANDLE *handle)
+{
+    return tuya_mem_heap_create_ext(start_addr, size, HEAP_ALGO_FIRST_FIT, handle);
+}
+
+int tuya_mem_heap_create_ext(void *start_addr, unsigned int size, HEAP_ALGO_E algo, HEAP_HANDLE *handle)
 {
     MEM_Heap_t * pMemHeap = NULL;
 
-    s_heap_ctx.dbg_output("[MEM DBG] heap init-------size:%d addr:%p---------\r\n", size, start_addr);
+    s_heap_ctx.dbg_output("[MEM DBG] heap init-------size:%d addr:%p algo:%d---------\r\n", size, start_addr, algo);
 
-	pMemHeap = MEM_HeapCreate (start_addr, size);
+	pMemHeap = MEM_HeapCreate (start_addr, size, algo);
 	if(NULL == pMemHeap) {
 		return -1;
 	}
@@ -580,6 +1616,31 @@ int tuya_mem_heap_delete(HEAP_HANDLE handle)
 	return 0;
 }
 
+/*
+ * grow a TLSF heap by another region, release is called once the region is empty again, NULL to keep it.
+ * zeroed tells the memory reads zero (e.g. fresh anonymous mmap), calloc skips clearing what was never used.
+ */
+int tuya_mem_heap_add_region(HEAP_HANDLE handle, void *start_addr, unsigned int size, BOOL_T zeroed, HEAP_REGION_RELEASE_CB release)
+{
+    MEM_Heap_t *heap = (MEM_Heap_t *)handle;
+    unsigned long added = 0;
+
+    if(NULL == heap || NULL == start_addr || heap->algo != HEAP_ALGO_TLSF) {
+        return -1;
+    }
+
+    s_heap_ctx.enter_critical();
+    added = mem_tlsf_region_add(heap->tlsf, start_addr, size, zeroed, release);
+    if(added) {
+        heap->size += size;
+        heap->free += added;
+        s_heap_free_size += added;
+    }
+    s_heap_ctx.exit_critical();
+
+    return added ? 0 : -1;
+}
+
 void* tuya_mem_heap_malloc(HEAP_HANDLE handle, unsigned int size)
 {
     if(0 != handle) {
@@ -607,8 +1668,44 @@ void* tuya_mem_heap_malloc(HEAP_HANDLE handle, unsigned int size)
     }
 }
 
+/* align must be a power of two, above MEM_ALIGN_NUM it is supported by TLSF heaps only */
+void* tuya_mem_heap_malloc_aligned(HEAP_HANDLE handle, unsigned int size, unsigned int align)
+{
+    MEM_Heap_t *heap = (MEM_Heap_t *)handle;
+    long idx = 0;
+    void *ptr = NULL;
+
+    if(0 == align || (align & (align - 1))) {
+        return NULL;
+    }
+
+    if(align <= MEM_ALIGN_NUM) {
+        return tuya_mem_heap_malloc(handle, size);
+    }
+
+    if(0 != handle) {
+        return heap->algo == HEAP_ALGO_TLSF ? MEM_TlsfAllocate(heap, size, align, 0) : NULL;
+    }
+
+    for(idx = 0; idx < MEM_HEAP_LIST_NUM && NULL == ptr; idx ++) {
+        heap = &mem_heap_list[idx];
+        if(0 == heap->size) {
+            break;
+        }
+        if(heap->algo == HEAP_ALGO_TLSF) {
+            ptr = MEM_TlsfAllocate(heap, size, align, 0);
+        }
+    }
+
+    return ptr;
+}
+
 void* tuya_mem_heap_calloc(HEAP_HANDLE handle, unsigned int size)
 {
+    if(0 != handle && ((MEM_Heap_t *)handle)->algo == HEAP_ALGO_TLSF) {
+        return MEM_TlsfAllocate((MEM_Heap_t *)handle, size, 0, 1);
+    }
+
     void *ptr = tuya_mem_heap_malloc(handle, size);
     if(ptr) {
         memset(ptr, 0, size);
@@ -623,19 +1720,22 @@ void* tuya_mem_heap_realloc(HEAP_HANDLE handle, void *ptr, unsigned int size)
 		return tuya_mem_heap_malloc(handle, size);
 	}
 
-	MEM_HeapBlock_t *old_block = ( MEM_HeapBlock_t * ) ( ( unsigned long ) (intptr_t)ptr - MEM_BLOCK_HEAD_SIZE );
-	unsigned char* pdog = MEM_DOG_ADDR(old_block);
+	MEM_Heap_t *heap = MEM_HeapFind(handle, ptr);
+	unsigned long usable = heap ? MEM_UsableSize(heap, ptr) : 0;
 
-	if( *pdog  != MEM_BLOCK_STAT_USE ) {
-		s_heap_ctx.dbg_output ( "[MEM DBG] realloc MEM_DEBUG_DOG_TAG err %p,size=%d\r\n", ptr, old_block->size );
+	if( 0 == usable ) {
+		s_heap_ctx.dbg_output ( "[MEM DBG] realloc MEM_DEBUG_DOG_TAG err %p\r\n", ptr );
 		return NULL;
 	}
 
-	unsigned long new_size;
-	size = size < 4 ? 4 : size;
-
-	new_size = ALIGN_UP ( size + 1 ) + MEM_BLOCK_HEAD_SIZE;
-	if ( new_size <= old_block->size ) { // old buffer is big enough
+	if ( heap->algo == HEAP_ALGO_TLSF ) {
+		if ( 0 == MEM_TlsfResize ( heap, ptr, size ) ) {
+			return ptr;
+		}
+	} else if ( size <= usable ) { // old buffer is big enough
+		s_heap_ctx.enter_critical();
+		heap->realloc_fit++;
+		s_heap_ctx.exit_critical();
 		return ptr;
 	}
 
@@ -645,8 +1745,12 @@ void* tuya_mem_heap_realloc(HEAP_HANDLE handle, void *ptr, unsigned int size)
 		return NULL;
 	}
 
-	memcpy(tmp, ptr, old_block->size - MEM_BLOCK_HEAD_SIZE);
+	memcpy(tmp, ptr, usable < size ? usable : size);
 	tuya_mem_heap_free(handle, ptr);
+
+	s_heap_ctx.enter_critical();
+	heap->realloc_move++;
+	s_heap_ctx.exit_critical();
     return tmp;
 }
 
@@ -655,22 +1759,94 @@ void tuya_mem_heap_free(HEAP_HANDLE handle, void *ptr)
     if(0 != handle) {
         MEM_Deallocate((MEM_Heap_t *)handle, ptr);
     } else {
-        long idx = 0 ;
-        MEM_Heap_t  * pHeap = NULL;
+        MEM_Heap_t  * pHeap = MEM_HeapFind(0, ptr);
 
-        for ( idx = 0 ; idx < MEM_HEAP_LIST_NUM ; idx ++ )
-        {
-            pHeap = &mem_heap_list[idx] ;
-            if(pHeap->size > 0) {
-                if(((unsigned char *)ptr > pHeap->base) && ((unsigned char *)ptr < (pHeap->base + pHeap->size))) {
-                    MEM_Deallocate(pHeap, ptr);
-                    break;
-                }
-            } else {
+        if(pHeap) {
+            MEM_Deallocate(pHeap, ptr);
+        }
+    }
+}
+
+/* allocate up to num blocks of the same size, a TLSF heap does it in one critical section */
+int tuya_mem_heap_malloc_batch(HEAP_HANDLE handle, unsigned int size, void **ptrs, int num)
+{
+    MEM_Heap_t *heap = (MEM_Heap_t *)handle;
+    MEM_TlsfBlock_t *block = NULL;
+    unsigned long adjust = 0;
+    int cnt = 0;
+
+    if(NULL == ptrs || num <= 0) {
+        return 0;
+    }
+
+    if(0 == handle || heap->algo != HEAP_ALGO_TLSF) {
+        for(cnt = 0; cnt < num; cnt++) {
+            ptrs[cnt] = tuya_mem_heap_malloc(handle, size);
+            if(NULL == ptrs[cnt]) {
                 break;
             }
         }
+        return cnt;
+    }
+
+    adjust = mem_tlsf_adjust_size(size);
+    if(0 == adjust) {
+        return 0;
+    }
+
+    s_heap_ctx.enter_critical();
+    for(cnt = 0; cnt < num; cnt++) {
+        block = mem_tlsf_chunk_get(heap, adjust, 0, NULL);
+        if(NULL == block) {
+            break;
+        }
+        MEM_HeapUsed(heap, MEM_TLSF_SIZE(block) + MEM_TLSF_HEAD_SIZE);
+        ptrs[cnt] = MEM_TLSF_TO_PTR(block);
+    }
+    s_heap_ctx.exit_critical();
+
+    return cnt;
+}
+
+void tuya_mem_heap_free_batch(HEAP_HANDLE handle, void **ptrs, int num)
+{
+    MEM_Heap_t *heap = (MEM_Heap_t *)handle;
+    MEM_TlsfBlock_t *block = NULL;
+    MEM_TlsfRegion_t *region = NULL;
+    MEM_TlsfRegion_t *released = NULL;
+    int i = 0;
+
+    if(NULL == ptrs || num <= 0) {
+        return;
+    }
+
+    if(0 == handle || heap->algo != HEAP_ALGO_TLSF) {
+        for(i = 0; i < num; i++) {
+            tuya_mem_heap_free(handle, ptrs[i]);
+        }
+        return;
+    }
+
+    s_heap_ctx.enter_critical();
+    for(i = 0; i < num; i++) {
+        block = MEM_TLSF_FROM_PTR(ptrs[i]);
+        if(MEM_TLSF_IS_FREE(block)) {
+            s_heap_ctx.exit_critical();
+            s_heap_ctx.dbg_output("[MEM DBG] mem %p might be freed yet\r\n", ptrs[i]);
+            s_heap_ctx.enter_critical();
+            continue;
+        }
+        heap->free += MEM_TLSF_SIZE(block) + MEM_TLSF_HEAD_SIZE;
+        s_heap_free_size += MEM_TLSF_SIZE(block) + MEM_TLSF_HEAD_SIZE;
+        region = mem_tlsf_chunk_put(heap, block);
+        if(region) {
+            region->next = released;
+            released = region;
+        }
     }
+    s_heap_ctx.exit_critical();
+
+    mem_tlsf_region_release(released);
 }
 
 int tuya_mem_heap_available(HEAP_HANDLE handle)
@@ -690,6 +1866,7 @@ void tuya_mem_heap_state(HEAP_HANDLE handle, heap_state_t *state)
 
     MEM_Heap_t  * pHeap = (MEM_Heap_t *)handle;
 
+    memset(state, 0, sizeof(heap_state_t));
     if(0 == handle) {
         long idx = 0 ;
 
@@ -699,15 +1876,15 @@ void tuya_mem_heap_state(HEAP_HANDLE handle, heap_state_t *state)
         for(idx = 0; idx < MEM_HEAP_LIST_NUM; idx ++) {
             pHeap = &mem_heap_list[idx];
             if(pHeap->size > 0) {
-                state->total_size += pHeap->size;
+                MEM_HeapState(pHeap, state);
             } else {
                 break;
             }
         }
     } else {
-        state->total_size = pHeap->size;
         state->free_size = pHeap->free;
         state->free_watermark = pHeap->free_watermark;
+        MEM_HeapState(pHeap, state);
     }
 }
 
@@ -0,0 +1,242 @@
+/**
+ * @file tuya_mem_pool.c
+ * @brief tuya fixed size object pool module
+ * @version 1.0
+ * @date 2021-05-05
+ *
+ * @copyright Copyright 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tkl_system.h"
+#include "tkl_memory.h"
+
+#include "tuya_mem_pool.h"
+
+#if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS == OPERATING_SYSTEM)
+#define POOL_CREATE_LOCK(pool)    OPRT_OK
+#define POOL_RELEASE_LOCK(pool)   OPRT_OK
+#define POOL_LOCK(pool)   TKL_ENTER_CRITICAL()
+#define POOL_UNLOCK(pool) TKL_EXIT_CRITICAL()
+#else
+#include "tkl_mutex.h"
+
+#define POOL_CREATE_LOCK(pool)  tkl_mutex_create_init(&pool->mutex)
+#define POOL_RELEASE_LOCK(pool) tkl_mutex_release(pool->mutex)
+#define POOL_LOCK(pool)   tkl_mutex_lock(pool->mutex)
+#define POOL_UNLOCK(pool) tkl_mutex_unlock(pool->mutex)
+#endif
+
+#define POOL_ALIGN(x)   (((x) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+/* a slab is one heap block holding count objects */
+typedef struct mem_pool_slab {
+    struct mem_pool_slab *next;
+    void *align;
+    uint8_t data[];
+} MEM_POOL_SLAB_T;
+
+/* free objects are linked through their first word */
+typedef struct mem_pool_obj {
+    struct mem_pool_obj *next;
+} MEM_POOL_OBJ_T;
+
+typedef struct {
+#if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS != OPERATING_SYSTEM)
+    TKL_MUTEX_HANDLE mutex;
+#endif
+
+    uint32_t count;
+    MEM_POOL_OBJ_T *free_list;
+    MEM_POOL_SLAB_T *slab_list;
+    MEM_POOL_STAT_T stat;
+} MEM_POOL_T;
+
+static MEM_POOL_OBJ_T *__pool_grow(MEM_POOL_T *pool)
+{
+    MEM_POOL_SLAB_T *slab = NULL;
+    MEM_POOL_OBJ_T *obj = NULL;
+    uint32_t i = 0;
+
+    slab = (MEM_POOL_SLAB_T *)tkl_system_malloc(sizeof(MEM_POOL_SLAB_T) + (size_t)pool->count * pool->stat.obj_size);
+    if (NULL == slab) {
+        return NULL;
+    }
+
+    slab->next = pool->slab_list;
+    pool->slab_list = slab;
+
+    // keep the objects in address order on the free list
+    for (i = pool->count; i > 0; i--) {
+        obj = (MEM_POOL_OBJ_T *)(slab->data + (size_t)(i - 1) * pool->stat.obj_size);
+        obj->next = pool->free_list;
+        pool->free_list = obj;
+    }
+
+    pool->stat.slab_num++;
+    pool->stat.total += pool->count;
+
+    return pool->free_list;
+}
+
+/**
+ * @brief create a pool of fixed size objects
+ *
+ * @param[in] obj_size the object size
+ * @param[in] count the objects carved from the heap at once, the pool grows by the same count when exhausted
+ * @param[out] handle the pool handle
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_mem_pool_create(const uint32_t obj_size, const uint32_t count, MEM_POOL_HANDLE *handle)
+{
+    MEM_POOL_T *pool = NULL;
+    size_t size = 0;
+
+    if ((NULL == handle) || (0 == obj_size) || (0 == count)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    // the aligned size and a slab of count objects must not wrap
+    size = POOL_ALIGN((size_t)(obj_size < sizeof(MEM_POOL_OBJ_T) ? sizeof(MEM_POOL_OBJ_T) : obj_size));
+    if ((size < obj_size) || (size > UINT32_MAX) || (count > (SIZE_MAX - sizeof(MEM_POOL_SLAB_T)) / size)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    pool = (MEM_POOL_T *)tkl_system_malloc(sizeof(MEM_POOL_T));
+    if (NULL == pool) {
+        return OPRT_MALLOC_FAILED;
+    }
+    memset(pool, 0, sizeof(MEM_POOL_T));
+
+    if (OPRT_OK != POOL_CREATE_LOCK(pool)) {
+        tkl_system_free(pool);
+        return OPRT_COM_ERROR;
+    }
+
+    pool->count = count;
+    pool->stat.obj_size = (uint32_t)size;
+
+    if (NULL == __pool_grow(pool)) {
+        POOL_RELEASE_LOCK(pool);
+        tkl_system_free(pool);
+        return OPRT_MALLOC_FAILED;
+    }
+
+    *handle = (MEM_POOL_HANDLE)pool;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief take one object from the pool
+ *
+ * @param[in] handle the pool handle
+ *
+ * @return the object address, NULL on failed
+ */
+void *tuya_mem_pool_alloc(MEM_POOL_HANDLE handle)
+{
+    MEM_POOL_T *pool = (MEM_POOL_T *)handle;
+    MEM_POOL_OBJ_T *obj = NULL;
+
+    if (NULL == pool) {
+        return NULL;
+    }
+
+    POOL_LOCK(pool);
+    obj = pool->free_list;
+    if (NULL == obj) {
+        obj = __pool_grow(pool);
+    }
+
+    if (obj) {
+        pool->free_list = obj->next;
+        pool->stat.alloc_cnt++;
+        if (++pool->stat.used > pool->stat.peak) {
+            pool->stat.peak = pool->stat.used;
+        }
+    } else {
+        pool->stat.fail_cnt++;
+    }
+    POOL_UNLOCK(pool);
+
+    return obj;
+}
+
+/**
+ * @brief give the object back to the pool
+ *
+ * @param[in] handle the pool handle
+ * @param[in] obj the object taken from this pool
+ *
+ * @return void
+ */
+void tuya_mem_pool_free(MEM_POOL_HANDLE handle, void *obj)
+{
+    MEM_POOL_T *pool = (MEM_POOL_T *)handle;
+
+    if (NULL == pool || NULL == obj) {
+        return;
+    }
+
+    POOL_LOCK(pool);
+    ((MEM_POOL_OBJ_T *)obj)->next = pool->free_list;
+    pool->free_list = (MEM_POOL_OBJ_T *)obj;
+    pool->stat.used--;
+    POOL_UNLOCK(pool);
+}
+
+/**
+ * @brief get the statistics of the pool
+ *
+ * @param[in] handle the pool handle
+ * @param[out] stat the statistics
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_mem_pool_stat(MEM_POOL_HANDLE handle, MEM_POOL_STAT_T *stat)
+{
+    MEM_POOL_T *pool = (MEM_POOL_T *)handle;
+
+    if (NULL == pool || NULL == stat) {
+        return OPRT_INVALID_PARM;
+    }
+
+    POOL_LOCK(pool);
+    memcpy(stat, &pool->stat, sizeof(MEM_POOL_STAT_T));
+    POOL_UNLOCK(pool);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief release the pool and all the slabs
+ *
+ * @param[in] handle the pool handle
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @warning objects still in use become invalid
+ */
+OPERATE_RET tuya_mem_pool_release(MEM_POOL_HANDLE handle)
+{
+    MEM_POOL_T *pool = (MEM_POOL_T *)handle;
+    MEM_POOL_SLAB_T *slab = NULL;
+    OPERATE_RET op_ret = OPRT_OK;
+
+    if (NULL == pool) {
+        return OPRT_INVALID_PARM;
+    }
+
+    while (pool->slab_list) {
+        slab = pool->slab_list;
+        pool->slab_list = slab->next;
+        tkl_system_free(slab);
+    }
+
+    op_ret = POOL_RELEASE_LOCK(pool);
+    tkl_system_free(pool);
+
+    return op_ret;
+}
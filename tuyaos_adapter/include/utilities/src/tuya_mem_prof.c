@@ -0,0 +1,287 @@
+/**
+ * @file tuya_mem_prof.c
+ * @brief tuya allocation site heap profiler module
+ * @version 1.0
+ * @date 2021-05-05
+ *
+ * @copyright Copyright 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <string.h>
+
+#include "tkl_system.h"
+#include "tkl_memory.h"
+
+#include "tuya_mem_prof.h"
+
+/*
+ * the profiler is called from inside the allocator, so it can not take a
+ * tkl_mutex which allocates itself, only sampled allocations get here and
+ * the lock is held for a few instructions
+ */
+#if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS == OPERATING_SYSTEM)
+#define PROF_LOCK()   TKL_ENTER_CRITICAL()
+#define PROF_UNLOCK() TKL_EXIT_CRITICAL()
+#else
+#define PROF_LOCK()   while (__atomic_test_and_set(&s_prof.lock, __ATOMIC_ACQUIRE))
+#define PROF_UNLOCK() __atomic_clear(&s_prof.lock, __ATOMIC_RELEASE)
+#endif
+
+#ifndef MEM_PROF_SITE_MAX
+#define MEM_PROF_SITE_MAX   (512)   // power of two
+#endif
+
+#define PROF_SITE_OTHER     (0)     // takes the sites that find the table full
+
+typedef struct {
+    volatile char lock;
+    uint32_t sample_rate;
+    uint32_t site_num;
+    uint16_t slot[MEM_PROF_SITE_MAX];   // caller hash -> site index, 0 for empty
+    MEM_PROF_SITE_T site[MEM_PROF_SITE_MAX];
+} MEM_PROF_T;
+
+static MEM_PROF_T s_prof = {
+    .site_num = 1,
+};
+
+static uint32_t __prof_hash(const void *caller)
+{
+    uintptr_t key = (uintptr_t)caller;
+
+    key ^= key >> 17;
+    key *= 0x9E3779B1u;
+    return (uint32_t)(key ^ (key >> 15)) & (MEM_PROF_SITE_MAX - 1);
+}
+
+/* called locked */
+static uint32_t __prof_site_get(const void *caller)
+{
+    uint32_t idx = __prof_hash(caller);
+    uint32_t i = 0;
+
+    for (i = 0; i < MEM_PROF_SITE_MAX; i++, idx = (idx + 1) & (MEM_PROF_SITE_MAX - 1)) {
+        if (0 == s_prof.slot[idx]) {
+            break;
+        }
+        if (s_prof.site[s_prof.slot[idx]].caller == caller) {
+            return s_prof.slot[idx];
+        }
+    }
+
+    // the table keeps a free slot, site 0 does not take one
+    if (s_prof.site_num >= MEM_PROF_SITE_MAX - 1 || i == MEM_PROF_SITE_MAX) {
+        return PROF_SITE_OTHER;
+    }
+
+    s_prof.slot[idx] = (uint16_t)s_prof.site_num;
+    s_prof.site[s_prof.site_num].caller = caller;
+
+    return s_prof.site_num++;
+}
+
+/**
+ * @brief start sampling allocations
+ *
+ * @param[in] sample_rate record one in sample_rate allocations, 1 records all of them
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note the counters are kept over stop and start, blocks sampled before
+ *       stopping are still accounted when they are freed
+ */
+OPERATE_RET tuya_mem_prof_start(const uint32_t sample_rate)
+{
+    if (0 == sample_rate) {
+        return OPRT_INVALID_PARM;
+    }
+
+    __atomic_store_n(&s_prof.sample_rate, sample_rate, __ATOMIC_RELAXED);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief stop sampling allocations
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_mem_prof_stop(void)
+{
+    __atomic_store_n(&s_prof.sample_rate, 0, __ATOMIC_RELAXED);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief get the sample rate for the allocator
+ *
+ * @return the sample rate, 0 if the profiler is stopped
+ */
+uint32_t tuya_mem_prof_sample_rate(void)
+{
+    return __atomic_load_n(&s_prof.sample_rate, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief account a sampled allocation, called by the allocator
+ *
+ * @param[in] caller the return address of the allocation call
+ * @param[in] size the requested size
+ * @param[in] weight the allocations the sample stands for
+ * @param[out] rec the record to keep with the block
+ *
+ * @return void
+ */
+void tuya_mem_prof_alloc(const void *caller, const uint32_t size, const uint32_t weight, MEM_PROF_REC_T *rec)
+{
+    MEM_PROF_SITE_T *site = NULL;
+
+    PROF_LOCK();
+    rec->site = __prof_site_get(caller);
+    site = &s_prof.site[rec->site];
+    site->alloc_cnt += weight;
+    site->live_cnt += weight;
+    site->live_bytes += (int64_t)size * weight;
+    if (site->live_bytes > site->peak_bytes) {
+        site->peak_bytes = site->live_bytes;
+    }
+    PROF_UNLOCK();
+
+    rec->weight = weight;
+    rec->size = size;
+    rec->resv = 0;
+}
+
+/**
+ * @brief account the free of a sampled block, called by the allocator
+ *
+ * @param[in] rec the record kept with the block
+ *
+ * @return void
+ */
+void tuya_mem_prof_free(const MEM_PROF_REC_T *rec)
+{
+    MEM_PROF_SITE_T *site = NULL;
+
+    if (rec->site >= MEM_PROF_SITE_MAX) {
+        return;
+    }
+
+    PROF_LOCK();
+    site = &s_prof.site[rec->site];
+    site->live_cnt -= rec->weight;
+    site->live_bytes -= (int64_t)rec->size * rec->weight;
+    PROF_UNLOCK();
+}
+
+static MEM_PROF_SNAPSHOT_T *__prof_snapshot_alloc(uint32_t site_num)
+{
+    MEM_PROF_SNAPSHOT_T *snapshot = NULL;
+
+    snapshot = (MEM_PROF_SNAPSHOT_T *)tkl_system_malloc(sizeof(MEM_PROF_SNAPSHOT_T) + site_num * sizeof(MEM_PROF_SITE_T));
+    if (snapshot) {
+        memset(snapshot, 0, sizeof(MEM_PROF_SNAPSHOT_T));
+    }
+
+    return snapshot;
+}
+
+/**
+ * @brief take a snapshot of the counters of all sites
+ *
+ * @param[out] snapshot the snapshot, release it by tuya_mem_prof_snapshot_free
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_mem_prof_snapshot(MEM_PROF_SNAPSHOT_T **snapshot)
+{
+    MEM_PROF_SNAPSHOT_T *snap = NULL;
+    uint32_t site_num = 0;
+
+    if (NULL == snapshot) {
+        return OPRT_INVALID_PARM;
+    }
+
+    // sites are only added, those added after here show up in the next snapshot
+    site_num = __atomic_load_n(&s_prof.site_num, __ATOMIC_RELAXED);
+    snap = __prof_snapshot_alloc(site_num);
+    if (NULL == snap) {
+        return OPRT_MALLOC_FAILED;
+    }
+
+    PROF_LOCK();
+    memcpy(snap->site, s_prof.site, site_num * sizeof(MEM_PROF_SITE_T));
+    PROF_UNLOCK();
+
+    snap->sample_rate = tuya_mem_prof_sample_rate();
+    snap->site_num = site_num;
+    *snapshot = snap;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief get what changed between two snapshots
+ *
+ * @param[in] from the older snapshot
+ * @param[in] to the newer snapshot
+ * @param[out] diff the sites changed, sorted by live_bytes growth, release it by tuya_mem_prof_snapshot_free
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note live_bytes, live_cnt and alloc_cnt are the differences, peak_bytes is taken from to
+ */
+OPERATE_RET tuya_mem_prof_diff(const MEM_PROF_SNAPSHOT_T *from, const MEM_PROF_SNAPSHOT_T *to, MEM_PROF_SNAPSHOT_T **diff)
+{
+    MEM_PROF_SNAPSHOT_T *out = NULL;
+    MEM_PROF_SITE_T site;
+    uint32_t i = 0, j = 0;
+
+    if (NULL == from || NULL == to || NULL == diff) {
+        return OPRT_INVALID_PARM;
+    }
+
+    out = __prof_snapshot_alloc(to->site_num);
+    if (NULL == out) {
+        return OPRT_MALLOC_FAILED;
+    }
+    out->sample_rate = to->sample_rate;
+
+    // site indexes never change, a snapshot is a prefix of any later one
+    for (i = 0; i < to->site_num; i++) {
+        site = to->site[i];
+        if (i < from->site_num) {
+            site.live_bytes -= from->site[i].live_bytes;
+            site.live_cnt -= from->site[i].live_cnt;
+            site.alloc_cnt -= from->site[i].alloc_cnt;
+        }
+        if (0 == site.live_bytes && 0 == site.alloc_cnt) {
+            continue;
+        }
+
+        // insertion sort, biggest growth first
+        for (j = out->site_num; j > 0 && out->site[j - 1].live_bytes < site.live_bytes; j--) {
+            out->site[j] = out->site[j - 1];
+        }
+        out->site[j] = site;
+        out->site_num++;
+    }
+
+    *diff = out;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief release a snapshot
+ *
+ * @param[in] snapshot the snapshot
+ *
+ * @return void
+ */
+void tuya_mem_prof_snapshot_free(MEM_PROF_SNAPSHOT_T *snapshot)
+{
+    tkl_system_free(snapshot);
+}
@@ -13,6 +13,7 @@
 
 #include "tuya_list.h"
 #include "tuya_queue.h"
+#include "tuya_mem_pool.h"
 
 #if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS == OPERATING_SYSTEM)
 #define QUEUE_CREATE_LOCK(queue)    OPRT_OK
@@ -28,6 +29,16 @@
 #define QUEUE_UNLOCK(queue) tkl_mutex_unlock(queue->mutex)
 #endif
 
+/* items carved from the pool at once */
+#ifndef QUEUE_ITEM_POOL_NUM
+#define QUEUE_ITEM_POOL_NUM 32
+#endif
+
+/* the backend of tuya_queue_create */
+#ifndef TUYA_QUEUE_DEFAULT_TYPE
+#define TUYA_QUEUE_DEFAULT_TYPE TUYA_QUEUE_LIST
+#endif
+
 typedef enum {
     POLICY_SEND_TO_BACK,
     POLICY_SEND_TO_FRONT,
@@ -47,10 +58,65 @@ typedef struct {
     uint32_t item_size;
     uint32_t queue_len;
     uint32_t queue_free;
-    
+
+    MEM_POOL_HANDLE pool;   // TUYA_QUEUE_LIST
     LIST_HEAD head;
+
+    uint8_t *ring;          // TUYA_QUEUE_RING, queue_len items, NULL for a list
+    uint32_t ring_head;     // slot of the first item
 }TUYA_QUEUE_T;
 
+/* the slot index of the item at position pos from the head, pos <= queue_len */
+static inline uint32_t __ring_index(TUYA_QUEUE_T *queue, uint32_t pos)
+{
+    uint32_t idx = queue->ring_head + pos;
+
+    if (idx >= queue->queue_len) {
+        idx -= queue->queue_len;
+    }
+
+    return idx;
+}
+
+#define __ring_item(queue, pos) ((queue)->ring + (size_t)__ring_index(queue, pos) * (queue)->item_size)
+
+/* copy num items from position start of the ring, called locked, at most two copies */
+static void __ring_copy(TUYA_QUEUE_T *queue, uint32_t start, uint8_t *items, uint32_t num)
+{
+    uint32_t first = __ring_index(queue, start);
+    uint32_t part = queue->queue_len - first;
+
+    if (part > num) {
+        part = num;
+    }
+
+    memcpy(items, queue->ring + (size_t)first * queue->item_size, (size_t)part * queue->item_size);
+    if (num > part) {
+        memcpy(items + (size_t)part * queue->item_size, queue->ring, (size_t)(num - part) * queue->item_size);
+    }
+}
+
+static OPERATE_RET __ring_enqueue(TUYA_QUEUE_T *queue, const void *item, ENQUEUE_POLICY_E policy)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+
+    QUEUE_LOCK(queue);
+    if(queue->queue_free > 0) {
+        if(POLICY_SEND_TO_BACK == policy) {
+            memcpy(__ring_item(queue, queue->queue_len - queue->queue_free), item, queue->item_size);
+        } else {
+            queue->ring_head = (queue->ring_head ? queue->ring_head : queue->queue_len) - 1;
+            memcpy(__ring_item(queue, 0), item, queue->item_size);
+        }
+        queue->queue_free--;
+    } else {
+        op_ret = OPRT_EXCEED_UPPER_LIMIT;
+    }
+    QUEUE_UNLOCK(queue);
+
+    return op_ret;
+}
+
 static OPERATE_RET __enqueue(TUYA_QUEUE_HANDLE handle, const void *item, ENQUEUE_POLICY_E policy)
 {
     OPERATE_RET op_ret = OPRT_OK;
@@ -60,8 +126,12 @@ static OPERATE_RET __enqueue(TUYA_QUEUE_HANDLE handle, const void *item, ENQUEUE
     }
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
-    
-    QUEUE_ITEM_T *queue_item = (QUEUE_ITEM_T *)tkl_system_malloc(sizeof(QUEUE_ITEM_T) + queue->item_size);
+
+    if(queue->ring) {
+        return __ring_enqueue(queue, item, policy);
+    }
+
+    QUEUE_ITEM_T *queue_item = (QUEUE_ITEM_T *)tuya_mem_pool_alloc(queue->pool);
     if(NULL == queue_item) {
         return OPRT_MALLOC_FAILED;
     }
@@ -78,7 +148,7 @@ static OPERATE_RET __enqueue(TUYA_QUEUE_HANDLE handle, const void *item, ENQUEUE
         }
         queue->queue_free--;
     } else {
-        tkl_system_free(queue_item);
+        tuya_mem_pool_free(queue->pool, queue_item);
         op_ret = OPRT_EXCEED_UPPER_LIMIT;
     }
     QUEUE_UNLOCK(queue);
@@ -99,11 +169,26 @@ static OPERATE_RET __enqueue(TUYA_QUEUE_HANDLE handle, const void *item, ENQUEUE
  * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
  */
 OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size, TUYA_QUEUE_HANDLE *handle)
+{
+    return tuya_queue_create_ext(queue_len, item_size, TUYA_QUEUE_DEFAULT_TYPE, handle);
+}
+
+/**
+ * @brief create and initialize a queue (FIFO) with the given backend
+ *
+ * @param[in] queue_len the maximum number of items that the queue can contain.
+ * @param[in] item_size the number of bytes each item in the queue will require.
+ * @param[in] type the backend
+ * @param[out] handle the queue handle
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_queue_create_ext(const uint32_t queue_len, const uint32_t item_size, const TUYA_QUEUE_TYPE_E type, TUYA_QUEUE_HANDLE *handle)
 {
     OPERATE_RET op_ret = OPRT_OK;
     TUYA_QUEUE_T *queue = NULL;
 
-    if((NULL == handle) || (0 == queue_len) || (0 == item_size)) {
+    if((NULL == handle) || (0 == queue_len) || (0 == item_size) || (type >= TUYA_QUEUE_TYPE_MAX)) {
         return OPRT_INVALID_PARM;
     }
 
@@ -111,6 +196,7 @@ OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size
     if(!queue) {
         return OPRT_MALLOC_FAILED;
     }
+    memset(queue, 0, sizeof(TUYA_QUEUE_T));
 
     op_ret = QUEUE_CREATE_LOCK(queue);
     if(OPRT_OK != op_ret) {
@@ -118,6 +204,19 @@ OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size
         return OPRT_COM_ERROR;
     }
 
+    if(TUYA_QUEUE_RING == type) {
+        queue->ring = (uint8_t *)tkl_system_malloc((size_t)queue_len * item_size);
+        op_ret = queue->ring ? OPRT_OK : OPRT_MALLOC_FAILED;
+    } else {
+        op_ret = tuya_mem_pool_create(sizeof(QUEUE_ITEM_T) + item_size,
+                                      queue_len < QUEUE_ITEM_POOL_NUM ? queue_len : QUEUE_ITEM_POOL_NUM, &queue->pool);
+    }
+    if(OPRT_OK != op_ret) {
+        QUEUE_RELEASE_LOCK(queue);
+        tkl_system_free(queue);
+        return op_ret;
+    }
+
     queue->item_size = item_size;
     queue->queue_len = queue_len;
     queue->queue_free = queue_len;
@@ -173,13 +272,19 @@ OPERATE_RET tuya_queue_output(TUYA_QUEUE_HANDLE handle, const void *item)
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
 
     QUEUE_LOCK(queue);
-    if(queue->queue_free < queue->queue_len) {
+    if(queue->queue_free < queue->queue_len && queue->ring) {
+        if(item) {
+            memcpy((void *)item, __ring_item(queue, 0), queue->item_size);
+        }
+        queue->ring_head = __ring_index(queue, 1);
+        queue->queue_free++;
+    } else if(queue->queue_free < queue->queue_len) {
         QUEUE_ITEM_T *queue_item = tuya_list_entry(queue->head.next, QUEUE_ITEM_T, node);
         if(item) {
             memcpy((void *)item, queue_item->data, queue->item_size);
         }
         tuya_list_del(&(queue_item->node));
-        tkl_system_free(queue_item);
+        tuya_mem_pool_free(queue->pool, queue_item);
         queue->queue_free++;
     } else {
         op_ret = OPRT_NOT_FOUND;
@@ -208,7 +313,9 @@ OPERATE_RET tuya_queue_peek(TUYA_QUEUE_HANDLE handle, const void *item)
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
 
     QUEUE_LOCK(queue);
-    if(queue->queue_free < queue->queue_len) {
+    if(queue->queue_free < queue->queue_len && queue->ring) {
+        memcpy((void *)item, __ring_item(queue, 0), queue->item_size);
+    } else if(queue->queue_free < queue->queue_len) {
         QUEUE_ITEM_T *queue_item = tuya_list_entry(queue->head.next, QUEUE_ITEM_T, node);
         memcpy((void *)item, queue_item->data, queue->item_size);
     } else {
@@ -235,12 +342,21 @@ OPERATE_RET tuya_queue_traverse(TUYA_QUEUE_HANDLE handle, TRAVERSE_CB cb, void *
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
     struct tuya_list_head *p = NULL;
     QUEUE_ITEM_T *queue_item = NULL;
+    uint32_t i = 0;
 
     QUEUE_LOCK(queue);
-    tuya_list_for_each(p, &(queue->head)) {
-        queue_item = tuya_list_entry(p, QUEUE_ITEM_T, node);
-        if(!cb(queue_item->data, ctx)) {
-            break;
+    if(queue->ring) {
+        for(i = 0; i < queue->queue_len - queue->queue_free; i++) {
+            if(!cb(__ring_item(queue, i), ctx)) {
+                break;
+            }
+        }
+    } else {
+        tuya_list_for_each(p, &(queue->head)) {
+            queue_item = tuya_list_entry(p, QUEUE_ITEM_T, node);
+            if(!cb(queue_item->data, ctx)) {
+                break;
+            }
         }
     }
     QUEUE_UNLOCK(queue);
@@ -267,10 +383,14 @@ OPERATE_RET tuya_queue_clear(TUYA_QUEUE_HANDLE handle)
     QUEUE_ITEM_T *queue_item = NULL;
 
     QUEUE_LOCK(queue);
-    tuya_list_for_each_safe(p, n, &(queue->head)) {
-        queue_item = tuya_list_entry(p, QUEUE_ITEM_T, node);
-        tuya_list_del(&queue_item->node);
-        tkl_system_free(queue_item);
+    if(queue->ring) {
+        queue->ring_head = 0;
+    } else {
+        tuya_list_for_each_safe(p, n, &(queue->head)) {
+            queue_item = tuya_list_entry(p, QUEUE_ITEM_T, node);
+            tuya_list_del(&queue_item->node);
+            tuya_mem_pool_free(queue->pool, queue_item);
+        }
     }
     queue->queue_free = queue->queue_len;
     QUEUE_UNLOCK(queue);
@@ -300,6 +420,17 @@ OPERATE_RET tuya_queue_get_batch(TUYA_QUEUE_HANDLE handle, const uint32_t start,
     uint32_t index = 0;
     uint32_t count = 0;
 
+    if(queue->ring) {
+        QUEUE_LOCK(queue);
+        if(start > queue->queue_len - queue->queue_free || num > queue->queue_len - queue->queue_free - start) {
+            QUEUE_UNLOCK(queue);
+            return OPRT_NOT_FOUND;
+        }
+        __ring_copy(queue, start, (uint8_t *)items, num);
+        QUEUE_UNLOCK(queue);
+        return OPRT_OK;
+    }
+
     QUEUE_LOCK(queue);
     tuya_list_for_each(p, &(queue->head)) {
         if(index < start) {
@@ -341,6 +472,21 @@ OPERATE_RET tuya_queue_delete_batch(TUYA_QUEUE_HANDLE handle, const uint32_t num
         return OPRT_INVALID_PARM;
     }
 
+    TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
+
+    // as many as there are, then not found like the item by item path
+    if(queue->ring) {
+        QUEUE_LOCK(queue);
+        if(count > queue->queue_len - queue->queue_free) {
+            count = queue->queue_len - queue->queue_free;
+            op_ret = OPRT_NOT_FOUND;
+        }
+        queue->ring_head = __ring_index(queue, count);
+        queue->queue_free += count;
+        QUEUE_UNLOCK(queue);
+        return op_ret;
+    }
+
     while((count-- > 0) && (OPRT_OK == op_ret)) {
         op_ret = tuya_queue_output(handle, NULL);
     }
@@ -426,6 +572,11 @@ OPERATE_RET tuya_queue_release(TUYA_QUEUE_HANDLE handle)
 
     tuya_queue_clear(handle);
 
+    if(queue->ring) {
+        tkl_system_free(queue->ring);
+    } else {
+        tuya_mem_pool_release(queue->pool);
+    }
     op_ret = QUEUE_RELEASE_LOCK(queue);
     tkl_system_free(queue);
 
@@ -1,6 +1,16 @@
 #include "tkl_memory.h"
 #include "tuya_ringbuf.h"
 
+#if defined(OPERATING_SYSTEM) && (SYSTEM_LINUX == OPERATING_SYSTEM)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define RINGBUFF_MIRROR_SUPPORT (1)
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC             (0x0001U)
+#endif
+#endif
+
 
 
 #define RINGBUFF_FREE     tkl_system_free
@@ -12,50 +22,235 @@
 
 /*
  * ringbuff structure
+ *
+ * in and out run freely and wrap at 2^32, in - out is the used size and
+ * & mask the position in buff. Only the writer stores in and only the reader
+ * stores out, with release stores after the data and acquire loads of the
+ * other side, so one writer thread and one reader thread need no lock.
+ *
+ * In the coverage type the writer also moves out, before it overwrites the
+ * oldest data, and the reader moves out by compare and swap, a failed swap
+ * means the data it copied may be overwritten and it copies again.
+ *
+ * A mirror ringbuff maps the same pages twice in a row, buff[i + size] is
+ * buff[i], so any span of up to size bytes from any position is contiguous.
 */
 typedef struct {
     RINGBUFF_TYPE_E type;   ///< ringbuff type
-    uint8_t  reserved;      ///< Reserved
-    uint16_t in;            ///< position of input
-    uint16_t out;           ///< position of output
-    uint16_t len;           ///< length of buff data
-    uint8_t buff[];         ///< ring buff
+    uint32_t mask;          ///< size of buff - 1, the size is a power of two
+    uint32_t in;            ///< bytes written so far
+    uint32_t out;           ///< bytes read so far
+    uint32_t lost;          ///< bytes overwritten so far, coverage type
+    uint32_t span_out;      ///< out when the reader got its span, coverage type
+    BOOL_T mirror;          ///< buff is mapped twice
+    uint8_t *buff;          ///< ring buff, right after the structure unless mirrored
 } __RINGBUFF_T;
 
 #define RINGBUFF_SIZE   sizeof(__RINGBUFF_T)
+/* a full ring keeps in - out positive as int32_t */
+#define RINGBUFF_MAX    0x40000000u
 
 
-static void __ringbuff_init(__RINGBUFF_T *ringbuff, uint16_t len)
+static void __ringbuff_init(__RINGBUFF_T *ringbuff)
 {
     ringbuff->in = 0;
     ringbuff->out = 0;
-    ringbuff->len = len;
+    ringbuff->lost = 0;
+}
+
+/* copy len bytes at position pos of the ring to data, at most two copies */
+static void __ringbuff_copy_out(__RINGBUFF_T *rbuff, uint32_t pos, uint8_t *pdata, uint32_t len)
+{
+    uint32_t off = pos & rbuff->mask;
+    uint32_t tmp_len = rbuff->mirror ? len : GET_MIN(rbuff->mask + 1 - off, len);
+
+    memcpy(pdata, &rbuff->buff[off], tmp_len);
+    if (len > tmp_len) {
+        memcpy(&pdata[tmp_len], rbuff->buff, len - tmp_len);
+    }
+}
+
+/* copy len bytes of data to position pos of the ring, at most two copies */
+static void __ringbuff_copy_in(__RINGBUFF_T *rbuff, uint32_t pos, const uint8_t *pdata, uint32_t len)
+{
+    uint32_t off = pos & rbuff->mask;
+    uint32_t tmp_len = rbuff->mirror ? len : GET_MIN(rbuff->mask + 1 - off, len);
+
+    memcpy(&rbuff->buff[off], pdata, tmp_len);
+    if (len > tmp_len) {
+        memcpy(rbuff->buff, &pdata[tmp_len], len - tmp_len);
+    }
+}
+
+
+/*
+ * coverage write, never fails, the cost is bounded by the buff size: only the
+ * last size bytes of data are copied, out is moved past what gets overwritten
+ * before the copy so a reader copying that part sees its swap fail. The bytes
+ * skipped are lost without ever being in the ring, in and out only move by
+ * what is kept, so in - out stays within the buff size whatever len is
+ */
+static uint32_t __ringbuff_write_coverage(__RINGBUFF_T *rbuff, const uint8_t *pdata, uint32_t len)
+{
+    uint32_t size = rbuff->mask + 1;
+    uint32_t in = __atomic_load_n(&rbuff->in, __ATOMIC_RELAXED);
+    uint32_t skip = (len > size) ? len - size : 0;
+    uint32_t keep = len - skip;
+    uint32_t out = __atomic_load_n(&rbuff->out, __ATOMIC_ACQUIRE);
+    uint32_t new_out = in + keep - size;
+
+    // out is between in - size and in, the free space is out + size - in, and
+    // the reader may move out at the same time, it only goes forward
+    while (keep > (uint32_t)(out + size - in)) {
+        if (__atomic_compare_exchange_n(&rbuff->out, &out, new_out, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            skip += new_out - out;
+            break;
+        }
+    }
+    if (skip) {
+        __atomic_fetch_add(&rbuff->lost, skip, __ATOMIC_RELAXED);
+    }
+    // out is seen moved before any byte of the old data changes
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __ringbuff_copy_in(rbuff, in, &pdata[len - keep], keep);
+    __atomic_store_n(&rbuff->in, in + keep, __ATOMIC_RELEASE);
+
+    return len;
 }
 
+/* coverage read or peek, copies again when the writer overwrote the data meanwhile */
+static uint32_t __ringbuff_read_coverage(__RINGBUFF_T *rbuff, uint8_t *pdata, uint32_t len, BOOL_T consume)
+{
+    uint32_t in, out, seen, cnt;
+
+    out = __atomic_load_n(&rbuff->out, __ATOMIC_ACQUIRE);
+    for (;;) {
+        // the writer never moves out past in, in - out is at most the buff size unless out is stale
+        in = __atomic_load_n(&rbuff->in, __ATOMIC_ACQUIRE);
+        if ((int32_t)(in - out) <= 0) {
+            return 0;
+        }
+        cnt = GET_MIN(in - out, len);
+
+        __ringbuff_copy_out(rbuff, out, pdata, cnt);
+        if (consume) {
+            if (__atomic_compare_exchange_n(&rbuff->out, &out, out + cnt, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return cnt;
+            }
+            continue;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seen = out;
+        out = __atomic_load_n(&rbuff->out, __ATOMIC_RELAXED);
+        if (seen == out) {
+            return cnt;
+        }
+    }
+}
 
-OPERATE_RET tuya_ring_buff_create(uint16_t len, RINGBUFF_TYPE_E type, TUYA_RINGBUFF_T *ringbuff)
+OPERATE_RET tuya_ring_buff_create(uint32_t len, RINGBUFF_TYPE_E type, TUYA_RINGBUFF_T *ringbuff)
 {
     __RINGBUFF_T *rbuff = NULL;
     __RINGBUFF_T **out_ring_buff = (__RINGBUFF_T **)ringbuff;
-    
+    uint32_t size = 1;
 
-    if(type == OVERFLOW_COVERAGE_TYPE) {
-        return OPRT_NOT_SUPPORTED;
+
+    if(ringbuff == NULL || len == 0 || len > RINGBUFF_MAX || type > OVERFLOW_COVERAGE_TYPE) {
+        return OPRT_INVALID_PARM;
+    }
+
+    // masking instead of modulo, the size is rounded up to a power of two
+    while (size < len) {
+        size <<= 1;
     }
 
-    if(ringbuff == NULL || len == 0) {
+    rbuff = (__RINGBUFF_T *)RINGBUFF_MALLOC(RINGBUFF_SIZE+size);
+    if(rbuff == NULL) {
+        return OPRT_MALLOC_FAILED;
+    }
+    rbuff->type = type;
+    rbuff->mask = size - 1;
+    rbuff->mirror = FALSE;
+    rbuff->buff = (uint8_t *)(rbuff + 1);
+    __ringbuff_init(rbuff);
+    *out_ring_buff = rbuff;
+
+    return OPRT_OK;
+}
+
+
+#ifdef RINGBUFF_MIRROR_SUPPORT
+/* map one memfd of size bytes twice in a row, size is a multiple of the page size */
+static uint8_t *__ringbuff_mirror_map(uint32_t size)
+{
+    uint8_t *addr = MAP_FAILED;
+    int fd = -1;
+
+    fd = (int)syscall(SYS_memfd_create, "tuya_ringbuf", MFD_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, size) != 0) {
+        goto __exit;
+    }
+
+    // reserve both halves first so nothing else can be mapped in between
+    addr = mmap(NULL, (size_t)size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        goto __exit;
+    }
+    if (mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(addr, (size_t)size * 2);
+        addr = MAP_FAILED;
+    }
+
+__exit:
+    // the mappings keep the memory
+    close(fd);
+
+    return (addr == MAP_FAILED) ? NULL : addr;
+}
+#endif
+
+OPERATE_RET tuya_ring_buff_create_mirror(uint32_t len, RINGBUFF_TYPE_E type, TUYA_RINGBUFF_T *ringbuff)
+{
+#ifdef RINGBUFF_MIRROR_SUPPORT
+    __RINGBUFF_T *rbuff = NULL;
+    __RINGBUFF_T **out_ring_buff = (__RINGBUFF_T **)ringbuff;
+    uint32_t size = (uint32_t)sysconf(_SC_PAGESIZE);
+
+
+    if(ringbuff == NULL || len == 0 || len > RINGBUFF_MAX || type > OVERFLOW_COVERAGE_TYPE) {
         return OPRT_INVALID_PARM;
     }
-    
-    rbuff = (__RINGBUFF_T *)RINGBUFF_MALLOC(RINGBUFF_SIZE+len);
+
+    // the page size is a power of two, so is the size
+    while (size < len) {
+        size <<= 1;
+    }
+
+    rbuff = (__RINGBUFF_T *)RINGBUFF_MALLOC(RINGBUFF_SIZE);
     if(rbuff == NULL) {
         return OPRT_MALLOC_FAILED;
     }
+    rbuff->buff = __ringbuff_mirror_map(size);
+    if(rbuff->buff == NULL) {
+        RINGBUFF_FREE(rbuff);
+        return OPRT_MALLOC_FAILED;
+    }
     rbuff->type = type;
-    __ringbuff_init(rbuff, len);
+    rbuff->mask = size - 1;
+    rbuff->mirror = TRUE;
+    __ringbuff_init(rbuff);
     *out_ring_buff = rbuff;
 
     return OPRT_OK;
+#else
+    return OPRT_NOT_SUPPORTED;
+#endif
 }
 
 
@@ -66,6 +261,11 @@ OPERATE_RET tuya_ring_buff_free(TUYA_RINGBUFF_T ringbuff)
     if (rbuff == NULL) {
         return OPRT_INVALID_PARM;
     }
+#ifdef RINGBUFF_MIRROR_SUPPORT
+    if (rbuff->mirror) {
+        munmap(rbuff->buff, ((size_t)rbuff->mask + 1) * 2);
+    }
+#endif
     RINGBUFF_FREE(rbuff);
 
     return OPRT_OK;
@@ -78,158 +278,220 @@ OPERATE_RET tuya_ring_buff_reset(TUYA_RINGBUFF_T ringbuff)
     if (rbuff == NULL) {
         return OPRT_INVALID_PARM;
     }
-    __ringbuff_init(rbuff, rbuff->len);
+    __ringbuff_init(rbuff);
 
     return OPRT_OK;
 }
 
-uint16_t tuya_ring_buff_free_size_get(TUYA_RINGBUFF_T ringbuff)
+uint32_t tuya_ring_buff_free_size_get(TUYA_RINGBUFF_T ringbuff)
 {
-    uint16_t size, in, out;
     __RINGBUFF_T *rbuff = (__RINGBUFF_T *)ringbuff;
 
     if(rbuff == NULL) {
         return 0;
     }
 
-    in = rbuff->in;
-    out = rbuff->out;
-    if(in == out) {
-        size = rbuff->len;
-    }
-    else if (out > in) {
-        size = out - in;
-    }
-    else {
-        size = rbuff->len - (in - out);
-    }
-
-    return size - 1;
+    return rbuff->mask + 1 - tuya_ring_buff_used_size_get(rbuff);
 }
 
-uint16_t tuya_ring_buff_used_size_get(TUYA_RINGBUFF_T ringbuff)
+uint32_t tuya_ring_buff_used_size_get(TUYA_RINGBUFF_T ringbuff)
 {
-    uint16_t size, in, out;
+    uint32_t size, out;
     __RINGBUFF_T *rbuff = (__RINGBUFF_T *)ringbuff;
 
     if(rbuff == NULL) {
         return 0;
     }
 
-    in = rbuff->in;
-    out = rbuff->out;
-    if (in == out) {
-        size = 0;
-    } else if (in > out) {
-        size = in - out;
-    } else {
-        size = rbuff->len - (out - in);
+    // out first, a third thread may see in after the reader moved out past it
+    out = __atomic_load_n(&rbuff->out, __ATOMIC_ACQUIRE);
+    size = __atomic_load_n(&rbuff->in, __ATOMIC_ACQUIRE) - out;
+    if ((int32_t)size < 0) {
+        return 0;
     }
 
-    return size;
+    return GET_MIN(size, rbuff->mask + 1);
 }
 
-uint16_t tuya_ring_buff_write(TUYA_RINGBUFF_T ringbuff, const void *data, uint16_t len)
+uint32_t tuya_ring_buff_write(TUYA_RINGBUFF_T ringbuff, const void *data, uint32_t len)
 {
-    uint16_t tmp_len;
-    uint16_t free_len;
-    const uint8_t* pdata = data;
+    uint32_t in, out;
     __RINGBUFF_T *rbuff = (__RINGBUFF_T *)ringbuff;
 
     if(rbuff == NULL || data == NULL || len == 0) {
         return 0;
     }
+
+    if(rbuff->type == OVERFLOW_COVERAGE_TYPE) {
+        return __ringbuff_write_coverage(rbuff, data, len);
+    }
+
     // overwriting unread parts is not supported when the write is full
-    free_len = tuya_ring_buff_free_size_get(rbuff);
-    len = GET_MIN(free_len, len);
+    in = __atomic_load_n(&rbuff->in, __ATOMIC_RELAXED);
+    out = __atomic_load_n(&rbuff->out, __ATOMIC_ACQUIRE);
+    len = GET_MIN(rbuff->mask + 1 - (in - out), len);
     if(len == 0) {
         return 0;
     }
 
-    // write data to remaining buff
-    tmp_len = GET_MIN(rbuff->len - rbuff->in, len);
-    memcpy(&rbuff->buff[rbuff->in], pdata, tmp_len);
-    rbuff->in += tmp_len;
-    len -= tmp_len;
+    __ringbuff_copy_in(rbuff, in, data, len);
+    __atomic_store_n(&rbuff->in, in + len, __ATOMIC_RELEASE);
+
+    return len;
+}
+
+uint32_t tuya_ring_buff_read(TUYA_RINGBUFF_T ringbuff, void *data, uint32_t len)
+{
+    uint32_t in, out;
+    __RINGBUFF_T *rbuff = (__RINGBUFF_T *)ringbuff;
+
+    if(rbuff == NULL || data == NULL || len == 0) {
+        return 0;
+    }
 
-    // write remaining data to beginning of buffer
-    if (len > 0) {
-        memcpy(rbuff->buff, &pdata[tmp_len], len);
-        rbuff->in = len;
+    if(rbuff->type == OVERFLOW_COVERAGE_TYPE) {
+        return __ringbuff_read_coverage(rbuff, data, len, TRUE);
     }
 
-    // buff loopback check
-    if (rbuff->in >= rbuff->len) {
-        rbuff->in = 0;
+    out = __atomic_load_n(&rbuff->out, __ATOMIC_RELAXED);
+    in = __atomic_load_n(&rbuff->in, __ATOMIC_ACQUIRE);
+    len = GET_MIN(in - out, len);
+    if (len == 0) {
+        return 0;
     }
 
-    return tmp_len + len;
+    __ringbuff_copy_out(rbuff, out, data, len);
+    __atomic_store_n(&rbuff->out, out + len, __ATOMIC_RELEASE);
+
+    return len;
 }
 
-uint16_t tuya_ring_buff_read(TUYA_RINGBUFF_T ringbuff, void *data, uint16_t len)
+uint32_t tuya_ring_buff_peek(TUYA_RINGBUFF_T ringbuff, void *data, uint32_t len)
 {
-    uint16_t tmp_len;
-    uint16_t used_len;
-    uint8_t *pdata = data;
+    uint32_t in, out;
     __RINGBUFF_T *rbuff = (__RINGBUFF_T *)ringbuff;
 
     if(rbuff == NULL || data == NULL || len == 0) {
         return 0;
     }
 
-    used_len = tuya_ring_buff_used_size_get(rbuff);
-    len = GET_MIN(used_len, len);
+    if(rbuff->type == OVERFLOW_COVERAGE_TYPE) {
+        return __ringbuff_read_coverage(rbuff, data, len, FALSE);
+    }
+
+    out = __atomic_load_n(&rbuff->out, __ATOMIC_RELAXED);
+    in = __atomic_load_n(&rbuff->in, __ATOMIC_ACQUIRE);
+    len = GET_MIN(in - out, len);
     if (len == 0) {
         return 0;
     }
 
-    // read data from linear part of buffer
-    tmp_len = GET_MIN(rbuff->len - rbuff->out, len);
-    memcpy(pdata, &rbuff->buff[rbuff->out], tmp_len);
-    rbuff->out += tmp_len;
-    len -= tmp_len;
+    __ringbuff_copy_out(rbuff, out, data, len);
 
-    // read data from beginning of buffer (overflow part)
-    if (len > 0) {
-        memcpy(&pdata[tmp_len], rbuff->buff, len);
-        rbuff->out = len;
+    return len;
+}
+
+uint32_t tuya_ring_buff_lost_size_get(TUYA_RINGBUFF_T ringbuff)
+{
+    __RINGBUFF_T *rbuff = (__RINGBUFF_T *)ringbuff;
+
+    if(rbuff == NULL) {
+        return 0;
     }
 
-    // check end of buffer
-    if (rbuff->out >= rbuff->len) {
-        rbuff->out = 0;
+    return __atomic_load_n(&rbuff->lost, __ATOMIC_RELAXED);
+}
+
+uint32_t tuya_ring_buff_read_span_get(TUYA_RINGBUFF_T ringbuff, void **span)
+{
+    uint32_t in, out, off, len;
+    __RINGBUFF_T *rbuff = (__RINGBUFF_T *)ringbuff;
+
+    if(rbuff == NULL || span == NULL) {
+        return 0;
+    }
+
+    out = __atomic_load_n(&rbuff->out, __ATOMIC_ACQUIRE);
+    in = __atomic_load_n(&rbuff->in, __ATOMIC_ACQUIRE);
+    if ((int32_t)(in - out) <= 0) {
+        return 0;
     }
 
-    return tmp_len + len;
+    off = out & rbuff->mask;
+    len = rbuff->mirror ? in - out : GET_MIN(in - out, rbuff->mask + 1 - off);
+    rbuff->span_out = out;
+    *span = &rbuff->buff[off];
+
+    return len;
 }
 
-uint16_t tuya_ring_buff_peek(TUYA_RINGBUFF_T ringbuff, void *data, uint16_t len)
+uint32_t tuya_ring_buff_read_commit(TUYA_RINGBUFF_T ringbuff, uint32_t len)
 {
-    uint16_t out;
-    uint16_t tmp_len;
-    uint16_t used_len;
-    uint8_t *pdata = data;
+    uint32_t in, out;
     __RINGBUFF_T *rbuff = (__RINGBUFF_T *)ringbuff;
 
-    if(rbuff == NULL || data == NULL || len == 0) {
+    if(rbuff == NULL || len == 0) {
         return 0;
     }
 
-    out = rbuff->out;
-    used_len = tuya_ring_buff_used_size_get(rbuff);
+    if(rbuff->type == OVERFLOW_COVERAGE_TYPE) {
+        // the swap fails if the writer moved out, the span was overwritten
+        out = rbuff->span_out;
+        in = __atomic_load_n(&rbuff->in, __ATOMIC_ACQUIRE);
+        if ((int32_t)(in - out) <= 0) {
+            return 0;
+        }
+        len = GET_MIN(in - out, len);
+        if (!__atomic_compare_exchange_n(&rbuff->out, &out, out + len, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+        rbuff->span_out = out + len;
+        return len;
+    }
 
-    len = GET_MIN(len, used_len);
-    if (len == 0) {
+    out = __atomic_load_n(&rbuff->out, __ATOMIC_RELAXED);
+    in = __atomic_load_n(&rbuff->in, __ATOMIC_ACQUIRE);
+    len = GET_MIN(in - out, len);
+    __atomic_store_n(&rbuff->out, out + len, __ATOMIC_RELEASE);
+
+    return len;
+}
+
+uint32_t tuya_ring_buff_write_span_get(TUYA_RINGBUFF_T ringbuff, void **span)
+{
+    uint32_t in, out, off, free_len;
+    __RINGBUFF_T *rbuff = (__RINGBUFF_T *)ringbuff;
+
+    if(rbuff == NULL || span == NULL) {
         return 0;
     }
 
-    tmp_len = GET_MIN(rbuff->len - out, len);
-    memcpy(pdata, &rbuff->buff[out], tmp_len);
-    len -= tmp_len;
+    in = __atomic_load_n(&rbuff->in, __ATOMIC_RELAXED);
+    out = __atomic_load_n(&rbuff->out, __ATOMIC_ACQUIRE);
+    free_len = rbuff->mask + 1 - (in - out);
+    if (free_len == 0) {
+        return 0;
+    }
+
+    off = in & rbuff->mask;
+    *span = &rbuff->buff[off];
+
+    return rbuff->mirror ? free_len : GET_MIN(free_len, rbuff->mask + 1 - off);
+}
+
+uint32_t tuya_ring_buff_write_commit(TUYA_RINGBUFF_T ringbuff, uint32_t len)
+{
+    uint32_t in, out;
+    __RINGBUFF_T *rbuff = (__RINGBUFF_T *)ringbuff;
 
-    if (len > 0) {
-        memcpy(&pdata[tmp_len], rbuff->buff, len);
+    if(rbuff == NULL || len == 0) {
+        return 0;
     }
-    
-    return tmp_len + len;
+
+    in = __atomic_load_n(&rbuff->in, __ATOMIC_RELAXED);
+    out = __atomic_load_n(&rbuff->out, __ATOMIC_ACQUIRE);
+    len = GET_MIN(rbuff->mask + 1 - (in - out), len);
+    __atomic_store_n(&rbuff->in, in + len, __ATOMIC_RELEASE);
+
+    return len;
 }
@@ -9,21 +9,68 @@
  */
  
 #include "tuya_smartpointer.h"
+#include "tuya_mem_pool.h"
 #include "tkl_memory.h"
 #include <string.h>
 
-#if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS == OPERATING_SYSTEM)
-#define SP_CREATE_LOCK(sp_data)    (sp_data)
-#define SP_RELEASE_LOCK(sp_data)   (sp_data)
-#define SP_LOCK(sp_data)   TKL_ENTER_CRITICAL()
-#define SP_UNLOCK(sp_data) TKL_EXIT_CRITICAL()
-#else
-#define SP_CREATE_LOCK(sp_data)  tkl_mutex_create_init(&sp_data->mutex)
-#define SP_RELEASE_LOCK(sp_data) tkl_mutex_release(sp_data->mutex)
-#define SP_LOCK(sp_data)   tkl_mutex_lock(sp_data->mutex)
-#define SP_UNLOCK(sp_data) tkl_mutex_unlock(sp_data->mutex)
+/* smartpointers carved from the pool at once */
+#ifndef SP_POOL_NUM
+#define SP_POOL_NUM 16
 #endif
 
+/* pool of the smartpointers refer to the caller's data (malk is FALSE) */
+static MEM_POOL_HANDLE s_sp_pool = NULL;
+
+static MEM_POOL_HANDLE __sp_pool_get(void)
+{
+    MEM_POOL_HANDLE pool = __atomic_load_n(&s_sp_pool, __ATOMIC_ACQUIRE);
+    MEM_POOL_HANDLE expect = NULL;
+
+    if (pool) {
+        return pool;
+    }
+
+    if (OPRT_OK != tuya_mem_pool_create(sizeof(SMARTPOINTER_T), SP_POOL_NUM, &pool)) {
+        return NULL;
+    }
+
+    // lost the race, use the pool published by others
+    if (!__atomic_compare_exchange_n(&s_sp_pool, &expect, pool, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        tuya_mem_pool_release(pool);
+        pool = expect;
+    }
+
+    return pool;
+}
+
+/* the data copied in by create lives with the smartpointer until the last weak reference */
+static void __sp_data_free(SMARTPOINTER_T *sp_data)
+{
+    if (FALSE == sp_data->malk) {
+        tkl_system_free(sp_data->data);
+        sp_data->data = NULL;
+    }
+}
+
+static void __sp_free(SMARTPOINTER_T *sp_data)
+{
+    if (FALSE == sp_data->malk) {
+        tuya_mem_pool_free(s_sp_pool, sp_data);
+    } else {
+        tkl_system_free(sp_data);
+    }
+}
+
+static void __sp_weak_put(SMARTPOINTER_T *sp_data)
+{
+    // release orders this holder's accesses before the free by the last one
+    if (1 != __atomic_fetch_sub(&sp_data->weak, 1, __ATOMIC_RELEASE)) {
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    __sp_free(sp_data);
+}
+
 /**
  * @brief create a reference data
  * 
@@ -44,7 +91,7 @@ SMARTPOINTER_T *tuya_smartpointer_create(void *data, const uint32_t data_len, co
     if (TRUE == malk) {
         sp_data = (SMARTPOINTER_T *)tkl_system_malloc(sizeof(SMARTPOINTER_T) + data_len);
     } else {
-        sp_data = (SMARTPOINTER_T *)tkl_system_malloc(sizeof(SMARTPOINTER_T));
+        sp_data = (SMARTPOINTER_T *)tuya_mem_pool_alloc(__sp_pool_get());
     }
     
     if (NULL == sp_data) {
@@ -52,16 +99,16 @@ SMARTPOINTER_T *tuya_smartpointer_create(void *data, const uint32_t data_len, co
     }
     memset(sp_data,0,sizeof(SMARTPOINTER_T));
 
-    SP_CREATE_LOCK(sp_data);
-
     if (TRUE == malk) {
         sp_data->data = (int8_t *)sp_data + sizeof(SMARTPOINTER_T);
         memcpy(sp_data->data,data,data_len);
     } else {
         sp_data->data = data;
     }
+    sp_data->malk = malk;
     sp_data->data_len = data_len;
     sp_data->rfc = cnt;
+    sp_data->weak = 1;
 
     return sp_data;
 }
@@ -79,9 +126,8 @@ void tuya_smartpointer_get(SMARTPOINTER_T *sp_data)
         return;
     }
 
-    SP_LOCK(sp_data);
-    sp_data->rfc++;
-    SP_UNLOCK(sp_data);
+    // a new reference comes from one already held, nothing to order
+    __atomic_fetch_add(&sp_data->rfc, 1, __ATOMIC_RELAXED);
 
     return;
 }
@@ -100,21 +146,79 @@ void tuya_smartpointer_put(SMARTPOINTER_T *sp_data)
         return;
     }
 
-    uint32_t rfc = 0;
-    SP_LOCK(sp_data);
-    rfc = --sp_data->rfc;
-    SP_UNLOCK(sp_data);
-    if (0 == rfc) {
-        SP_RELEASE_LOCK(sp_data);
-        if(FALSE == sp_data->malk) {
-            tkl_system_free(sp_data->data);
-        }
-        tkl_system_free(sp_data);
+    if (1 != __atomic_fetch_sub(&sp_data->rfc, 1, __ATOMIC_RELEASE)) {
+        return;
+    }
+
+    // the last one sees the writes to the data of all others before releasing it
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    __sp_data_free(sp_data);
+    __sp_weak_put(sp_data);
+
+    return;
+}
+
+/**
+ * @brief get a weak reference, it keeps the smartpointer but not the data
+ * 
+ * @param[inout] sp_data the reference data, the caller holds a reference of it
+ * @return void 
+ */
+void tuya_smartpointer_weak_get(SMARTPOINTER_T *sp_data)
+{
+    if (NULL == sp_data) {
+        return;
     }
 
+    __atomic_fetch_add(&sp_data->weak, 1, __ATOMIC_RELAXED);
+
     return;
 }
 
+/**
+ * @brief put a weak reference
+ * 
+ * @param[inout] sp_data the reference data 
+ * @return void 
+ */
+void tuya_smartpointer_weak_put(SMARTPOINTER_T *sp_data)
+{
+    if (NULL == sp_data) {
+        return;
+    }
+
+    __sp_weak_put(sp_data);
+
+    return;
+}
+
+/**
+ * @brief get a reference from a weak reference
+ * 
+ * @param[inout] sp_data the reference data, the caller holds a weak reference of it
+ * @return sp_data with the reference increased, NULL if the data is already released
+ * 
+ * @note the weak reference is kept, put it by tuya_smartpointer_weak_put
+ */
+SMARTPOINTER_T *tuya_smartpointer_weak_lock(SMARTPOINTER_T *sp_data)
+{
+    uint32_t rfc = 0;
+
+    if (NULL == sp_data) {
+        return NULL;
+    }
+
+    // once 0 the data is gone for good, never bring it back
+    rfc = __atomic_load_n(&sp_data->rfc, __ATOMIC_RELAXED);
+    do {
+        if (0 == rfc) {
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&sp_data->rfc, &rfc, rfc + 1, TRUE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    return sp_data;
+}
+
 /**
  * @brief delete the reference data, ignore the reference
  * 
@@ -123,13 +227,13 @@ void tuya_smartpointer_put(SMARTPOINTER_T *sp_data)
  */
 void tuya_smartpointer_del(SMARTPOINTER_T *sp_data)
 {
-    SP_RELEASE_LOCK(sp_data);
-
-    if(FALSE == sp_data->malk) {
-        tkl_system_free(sp_data->data);
+    if (NULL == sp_data) {
+        return;
     }
-    
-    tkl_system_free(sp_data);
+
+    __sp_data_free(sp_data);
+    __sp_free(sp_data);
+
     return;
 }
 
@@ -10,15 +10,97 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "tuya_iot_config.h"
 #include "tkl_memory.h"
 #include "tuya_mem_heap.h"
+#include "tuya_mem_prof.h"
 
-#define MAX_HEAP_SIZE (512*1024)
+/*
+ * the heap starts with one region and grows by mmap'd regions on demand,
+ * regions that become empty again are unmapped, one spare is kept by the heap.
+ */
+#ifndef TKL_MEM_HEAP_INIT_SIZE
+#define TKL_MEM_HEAP_INIT_SIZE (512*1024)
+#endif
+
+#ifndef TKL_MEM_HEAP_GROW_SIZE
+#define TKL_MEM_HEAP_GROW_SIZE (1024*1024)
+#endif
+
+#ifndef TKL_MEM_HEAP_MAX_SIZE
+#define TKL_MEM_HEAP_MAX_SIZE (0)   // 0 means no limit
+#endif
+
+/*
+ * per-thread cache of small blocks in front of the shared heap
+ * every block carries one tag word in front of the user pointer: 0 for a
+ * block owned by the heap directly, otherwise the owner cache | size class.
+ */
+#define TC_TAG_SIZE         (sizeof(uintptr_t))
+#define TC_TAG_DIRECT       (0)
+#define TC_CLASS_MASK       (TC_CACHE_ALIGN - 1)
+#define TC_CACHE_ALIGN      (64)
+#define TC_CLASS_NUM        (10)
+#define TC_MAX_SIZE         (512)
+#define TC_BATCH_NUM        (16)     // blocks moved per refill or flush
+#define TC_BIN_MAX          (64)     // cached blocks per class before flushing
+#define TC_REMOTE_MAX       (256)    // pending remote frees before freeing to the heap
+
+#define TC_TAG(ptr)         (*(uintptr_t *)((uint8_t *)(ptr) - TC_TAG_SIZE))
+#define TC_NEXT(ptr)        (*(void **)(ptr))
+
+/*
+ * with ENABLE_MEM_PROF one in sample rate allocations bypasses the cache and
+ * carries a profiler record in front of the tag word, which is TC_TAG_PROF
+ */
+#if defined(ENABLE_MEM_PROF) && (ENABLE_MEM_PROF == 1)
+#define TC_TAG_PROF         (1)
+#define PROF_HEAD_SIZE      (sizeof(MEM_PROF_REC_T) + TC_TAG_SIZE)
+#define PROF_REC(ptr)       ((MEM_PROF_REC_T *)((uint8_t *)(ptr) - PROF_HEAD_SIZE))
+#define PROF_IDLE_SKIP      (4096)   // allocations between polls of a stopped profiler
+#define PROF_CALLER()       __builtin_return_address(0)
+#else
+#define PROF_CALLER()       NULL
+#endif
+
+typedef struct TKL_MEM_CACHE {
+    struct TKL_MEM_CACHE *next;         // link of s_tc_abandoned
+    void *bin[TC_CLASS_NUM];
+    uint32_t bin_cnt[TC_CLASS_NUM];
+    void *remote;                       // blocks freed by other threads
+    uint32_t remote_cnt;
+    int alive;
+} __attribute__((aligned(TC_CACHE_ALIGN))) TKL_MEM_CACHE_T;
+
+typedef enum {
+    TC_STATE_NONE = 0,
+    TC_STATE_ACTIVE,
+    TC_STATE_EXITED,
+} TC_STATE_E;
+
+static const uint16_t s_tc_class_size[TC_CLASS_NUM] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512};
 
 static pthread_mutex_t s_heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t s_heap_once = PTHREAD_ONCE_INIT;
 static HEAP_HANDLE s_heap_handle = NULL;
+static size_t s_heap_mapped = 0;
+
+static pthread_mutex_t s_tc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t s_tc_key;
+static TKL_MEM_CACHE_T *s_tc_abandoned = NULL;
+static __thread TKL_MEM_CACHE_T *s_tc = NULL;
+static __thread TC_STATE_E s_tc_state = TC_STATE_NONE;
+
+#if defined(ENABLE_MEM_PROF) && (ENABLE_MEM_PROF == 1)
+static __thread uint32_t s_prof_skip = 0;
+static __thread uint32_t s_prof_weight = 0;
+static __thread uint32_t s_prof_seed = 0;
+#endif
 
 static void __heap_lock(void)
 {
@@ -30,6 +112,64 @@ static void __heap_unlock(void)
     pthread_mutex_unlock(&s_heap_mutex);
 }
 
+static void __tc_thread_exit(void *arg);
+
+static void *__heap_region_map(size_t size)
+{
+    void *addr = NULL;
+    size_t mapped = __atomic_add_fetch(&s_heap_mapped, size, __ATOMIC_RELAXED);
+
+    if (TKL_MEM_HEAP_MAX_SIZE && mapped > (size_t)TKL_MEM_HEAP_MAX_SIZE) {
+        __atomic_sub_fetch(&s_heap_mapped, size, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == addr) {
+        __atomic_sub_fetch(&s_heap_mapped, size, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    return addr;
+}
+
+static void __heap_region_release(void *start_addr, unsigned int size)
+{
+    munmap(start_addr, size);
+    __atomic_sub_fetch(&s_heap_mapped, size, __ATOMIC_RELAXED);
+}
+
+/* add a region big enough for a block of size, 0 on success */
+static int __heap_grow(size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t region = 0;
+    void *addr = NULL;
+
+    // TLSF searches a list whose blocks are at least size rounded up by 1/16
+    region = size + (size >> 3) + page;
+    if (region < TKL_MEM_HEAP_GROW_SIZE) {
+        region = TKL_MEM_HEAP_GROW_SIZE;
+    }
+    region = (region + page - 1) & ~(page - 1);
+    if (region > UINT32_MAX || region < size) {
+        return -1;
+    }
+
+    addr = __heap_region_map(region);
+    if (NULL == addr) {
+        return -1;
+    }
+
+    // fresh anonymous pages read zero, calloc skips clearing them
+    if (0 != tuya_mem_heap_add_region(s_heap_handle, addr, region, TRUE, __heap_region_release)) {
+        __heap_region_release(addr, region);
+        return -1;
+    }
+
+    return 0;
+}
+
 static void __heap_init(void)
 {
     heap_context_t ctx = {0};
@@ -37,9 +177,330 @@ static void __heap_init(void)
     ctx.enter_critical = __heap_lock;
     ctx.exit_critical = __heap_unlock;
 
-    char* buf = malloc(MAX_HEAP_SIZE);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t *buf = NULL;
+
     tuya_mem_heap_init(&ctx);
-    tuya_mem_heap_create(buf, MAX_HEAP_SIZE, &s_heap_handle);
+    pthread_key_create(&s_tc_key, __tc_thread_exit);
+
+    // no heap, every allocation fails instead of using a bad one
+    buf = (uint8_t *)__heap_region_map(TKL_MEM_HEAP_INIT_SIZE);
+    if (NULL == buf) {
+        return;
+    }
+
+    // the heap control takes the first page, the rest is added as a fresh zeroed
+    // region like those of __heap_grow, so calloc skips clearing it as well,
+    // if adding fails the heap has the first page and __heap_grow maps the rest
+    if (TKL_MEM_HEAP_INIT_SIZE > 2 * page &&
+        0 == tuya_mem_heap_create_ext(buf, page, HEAP_ALGO_TLSF, &s_heap_handle)) {
+        tuya_mem_heap_add_region(s_heap_handle, buf + page, TKL_MEM_HEAP_INIT_SIZE - page, TRUE, NULL);
+        return;
+    }
+
+    // too small to split, or the control does not fit a page
+    tuya_mem_heap_create_ext(buf, TKL_MEM_HEAP_INIT_SIZE, HEAP_ALGO_TLSF, &s_heap_handle);
+}
+
+static int __tc_class_get(size_t size)
+{
+    int cls = 0;
+
+    for (cls = 0; cls < TC_CLASS_NUM; cls++) {
+        if (size <= s_tc_class_size[cls]) {
+            return cls;
+        }
+    }
+
+    return -1;
+}
+
+static void __tc_flush(TKL_MEM_CACHE_T *tc, int cls, uint32_t keep)
+{
+    void *blocks[TC_BATCH_NUM];
+    int num = 0;
+
+    while (tc->bin_cnt[cls] > keep) {
+        void *ptr = tc->bin[cls];
+        tc->bin[cls] = TC_NEXT(ptr);
+        tc->bin_cnt[cls]--;
+
+        blocks[num++] = (uint8_t *)ptr - TC_TAG_SIZE;
+        if (num == TC_BATCH_NUM) {
+            tuya_mem_heap_free_batch(s_heap_handle, blocks, num);
+            num = 0;
+        }
+    }
+
+    if (num) {
+        tuya_mem_heap_free_batch(s_heap_handle, blocks, num);
+    }
+}
+
+static void __tc_push(TKL_MEM_CACHE_T *tc, int cls, void *ptr)
+{
+    TC_NEXT(ptr) = tc->bin[cls];
+    tc->bin[cls] = ptr;
+    if (++tc->bin_cnt[cls] > TC_BIN_MAX) {
+        __tc_flush(tc, cls, TC_BIN_MAX + 1 - TC_BATCH_NUM);
+    }
+}
+
+static void __tc_drain_remote(TKL_MEM_CACHE_T *tc)
+{
+    void *ptr = NULL;
+    void *next = NULL;
+
+    if (NULL == __atomic_load_n(&tc->remote, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    ptr = __atomic_exchange_n(&tc->remote, NULL, __ATOMIC_ACQUIRE);
+    for (; ptr; ptr = next) {
+        next = TC_NEXT(ptr);
+        __atomic_fetch_sub(&tc->remote_cnt, 1, __ATOMIC_RELAXED);
+        __tc_push(tc, (int)(TC_TAG(ptr) & TC_CLASS_MASK), ptr);
+    }
+}
+
+static void __tc_remote_free(TKL_MEM_CACHE_T *owner, void *ptr)
+{
+    void *head = NULL;
+
+    if (!__atomic_load_n(&owner->alive, __ATOMIC_ACQUIRE) ||
+        __atomic_load_n(&owner->remote_cnt, __ATOMIC_RELAXED) >= TC_REMOTE_MAX) {
+        tuya_mem_heap_free(s_heap_handle, (uint8_t *)ptr - TC_TAG_SIZE);
+        return;
+    }
+
+    __atomic_fetch_add(&owner->remote_cnt, 1, __ATOMIC_RELAXED);
+    head = __atomic_load_n(&owner->remote, __ATOMIC_RELAXED);
+    do {
+        TC_NEXT(ptr) = head;
+    } while (!__atomic_compare_exchange_n(&owner->remote, &head, ptr, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void __tc_thread_exit(void *arg)
+{
+    TKL_MEM_CACHE_T *tc = (TKL_MEM_CACHE_T *)arg;
+    int cls = 0;
+
+    s_tc = NULL;
+    s_tc_state = TC_STATE_EXITED;
+
+    __tc_drain_remote(tc);
+    for (cls = 0; cls < TC_CLASS_NUM; cls++) {
+        __tc_flush(tc, cls, 0);
+    }
+
+    // keep the cache for the next thread, late remote frees stay queued on it
+    __atomic_store_n(&tc->alive, FALSE, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&s_tc_mutex);
+    tc->next = s_tc_abandoned;
+    s_tc_abandoned = tc;
+    pthread_mutex_unlock(&s_tc_mutex);
+}
+
+static TKL_MEM_CACHE_T *__tc_get(void)
+{
+    TKL_MEM_CACHE_T *tc = s_tc;
+
+    if (tc || TC_STATE_NONE != s_tc_state) {
+        return tc;
+    }
+
+    pthread_mutex_lock(&s_tc_mutex);
+    tc = s_tc_abandoned;
+    if (tc) {
+        s_tc_abandoned = tc->next;
+    }
+    pthread_mutex_unlock(&s_tc_mutex);
+
+    if (NULL == tc) {
+        if (0 != posix_memalign((void **)&tc, TC_CACHE_ALIGN, sizeof(TKL_MEM_CACHE_T))) {
+            s_tc_state = TC_STATE_EXITED;
+            return NULL;
+        }
+        memset(tc, 0, sizeof(TKL_MEM_CACHE_T));
+    }
+
+    tc->next = NULL;
+    __atomic_store_n(&tc->alive, TRUE, __ATOMIC_RELEASE);
+    pthread_setspecific(s_tc_key, tc);
+    s_tc = tc;
+    s_tc_state = TC_STATE_ACTIVE;
+
+    return tc;
+}
+
+static void *__tc_malloc(TKL_MEM_CACHE_T *tc, int cls)
+{
+    void *blocks[TC_BATCH_NUM];
+    void *ptr = NULL;
+    int num = 0;
+    int i = 0;
+
+    if (NULL == tc->bin[cls]) {
+        __tc_drain_remote(tc);
+    }
+
+    if (NULL == tc->bin[cls]) {
+        num = tuya_mem_heap_malloc_batch(s_heap_handle, s_tc_class_size[cls] + TC_TAG_SIZE, blocks, TC_BATCH_NUM);
+        if (0 == num && 0 == __heap_grow(s_tc_class_size[cls] + TC_TAG_SIZE)) {
+            num = tuya_mem_heap_malloc_batch(s_heap_handle, s_tc_class_size[cls] + TC_TAG_SIZE, blocks, TC_BATCH_NUM);
+        }
+        for (i = 0; i < num; i++) {
+            ptr = (uint8_t *)blocks[i] + TC_TAG_SIZE;
+            TC_TAG(ptr) = (uintptr_t)tc | (uintptr_t)cls;
+            TC_NEXT(ptr) = tc->bin[cls];
+            tc->bin[cls] = ptr;
+        }
+        tc->bin_cnt[cls] += num;
+    }
+
+    ptr = tc->bin[cls];
+    if (ptr) {
+        tc->bin[cls] = TC_NEXT(ptr);
+        tc->bin_cnt[cls]--;
+    }
+
+    return ptr;
+}
+
+/* a heap block with head bytes in front of size */
+static uint8_t *__heap_malloc(size_t size, size_t head, BOOL_T zero)
+{
+    void *(*alloc)(HEAP_HANDLE, unsigned int) = zero ? tuya_mem_heap_calloc : tuya_mem_heap_malloc;
+    uint8_t *block = NULL;
+
+    if (size > (size_t)(UINT32_MAX - head)) {
+        return NULL;
+    }
+
+    block = alloc(s_heap_handle, size + head);
+    if (NULL == block && 0 == __heap_grow(size + head)) {
+        block = alloc(s_heap_handle, size + head);
+    }
+
+    return block;
+}
+
+static void *__direct_malloc(size_t size, BOOL_T zero)
+{
+    uint8_t *block = __heap_malloc(size, TC_TAG_SIZE, zero);
+
+    if (NULL == block) {
+        return NULL;
+    }
+
+    *(uintptr_t *)block = TC_TAG_DIRECT;
+    return block + TC_TAG_SIZE;
+}
+
+#if defined(ENABLE_MEM_PROF) && (ENABLE_MEM_PROF == 1)
+/*
+ * the weight of this allocation if it is sampled, 0 otherwise
+ * the distance to the next sample is random with a mean of the sample rate,
+ * so periodic allocation patterns are not missed or hit every time
+ */
+static uint32_t __prof_sample(void)
+{
+    uint32_t weight = s_prof_weight;
+    uint32_t rate = 0;
+
+    if (s_prof_skip > 1) {
+        s_prof_skip--;
+        return 0;
+    }
+
+    rate = tuya_mem_prof_sample_rate();
+    if (0 == rate) {
+        s_prof_skip = PROF_IDLE_SKIP;
+        s_prof_weight = 0;
+        return weight;
+    }
+
+    if (0 == s_prof_seed) {
+        s_prof_seed = (uint32_t)(uintptr_t)&s_prof_seed | 1;
+    }
+    s_prof_seed ^= s_prof_seed << 13;
+    s_prof_seed ^= s_prof_seed >> 17;
+    s_prof_seed ^= s_prof_seed << 5;
+
+    s_prof_skip = (rate > 1) ? 1 + s_prof_seed % (2 * rate - 1) : 1;
+    s_prof_weight = rate;
+
+    return weight;
+}
+
+static void *__prof_malloc(size_t size, BOOL_T zero, const void *caller, uint32_t weight)
+{
+    uint8_t *block = __heap_malloc(size, PROF_HEAD_SIZE, zero);
+
+    if (NULL == block) {
+        return NULL;
+    }
+
+    tuya_mem_prof_alloc(caller, size, weight, (MEM_PROF_REC_T *)block);
+    block += PROF_HEAD_SIZE;
+    TC_TAG(block) = TC_TAG_PROF;
+
+    return block;
+}
+
+static void *__prof_realloc(void *ptr, size_t size, const void *caller)
+{
+    MEM_PROF_REC_T rec = *PROF_REC(ptr);
+    uint8_t *block = NULL;
+
+    if (size > (size_t)(UINT32_MAX - PROF_HEAD_SIZE)) {
+        return NULL;
+    }
+
+    block = tuya_mem_heap_realloc(s_heap_handle, PROF_REC(ptr), size + PROF_HEAD_SIZE);
+    if (NULL == block && 0 == __heap_grow(size + PROF_HEAD_SIZE)) {
+        block = tuya_mem_heap_realloc(s_heap_handle, PROF_REC(ptr), size + PROF_HEAD_SIZE);
+    }
+    if (NULL == block) {
+        return NULL;
+    }
+
+    // the block is accounted to the last resize
+    tuya_mem_prof_free(&rec);
+    tuya_mem_prof_alloc(caller, size, rec.weight, (MEM_PROF_REC_T *)block);
+
+    return block + PROF_HEAD_SIZE;
+}
+#endif
+
+static void *__system_malloc(size_t size, const void *caller)
+{
+    TKL_MEM_CACHE_T *tc = NULL;
+    void *ptr = NULL;
+    int cls = -1;
+
+#if defined(ENABLE_MEM_PROF) && (ENABLE_MEM_PROF == 1)
+    uint32_t weight = __prof_sample();
+    if (weight) {
+        return __prof_malloc(size, FALSE, caller, weight);
+    }
+#else
+    (void)caller;
+#endif
+
+    if (size <= TC_MAX_SIZE) {
+        cls = __tc_class_get(size);
+        tc = __tc_get();
+    }
+
+    if (tc) {
+        ptr = __tc_malloc(tc, cls);
+        if (ptr) {
+            return ptr;
+        }
+    }
+
+    return __direct_malloc(size, FALSE);
 }
 
 /**
@@ -53,11 +514,9 @@ static void __heap_init(void)
 */
 void* tkl_system_malloc(const SIZE_T size)
 {
-    if(!s_heap_handle) {
-        __heap_init();
-    }
+    pthread_once(&s_heap_once, __heap_init);
 
-    return tuya_mem_heap_malloc(s_heap_handle, size);
+    return __system_malloc(size, PROF_CALLER());
 }
 
 /**
@@ -71,8 +530,32 @@ void* tkl_system_malloc(const SIZE_T size)
 */
 void tkl_system_free(void* ptr)
 {
-    if(ptr) {
-        tuya_mem_heap_free(s_heap_handle, ptr);
+    TKL_MEM_CACHE_T *owner = NULL;
+    uintptr_t tag = 0;
+
+    if (NULL == ptr) {
+        return;
+    }
+
+    tag = TC_TAG(ptr);
+    if (TC_TAG_DIRECT == tag) {
+        tuya_mem_heap_free(s_heap_handle, (uint8_t *)ptr - TC_TAG_SIZE);
+        return;
+    }
+
+#if defined(ENABLE_MEM_PROF) && (ENABLE_MEM_PROF == 1)
+    if (TC_TAG_PROF == tag) {
+        tuya_mem_prof_free(PROF_REC(ptr));
+        tuya_mem_heap_free(s_heap_handle, PROF_REC(ptr));
+        return;
+    }
+#endif
+
+    owner = (TKL_MEM_CACHE_T *)(tag & ~(uintptr_t)TC_CLASS_MASK);
+    if (owner == s_tc) {
+        __tc_push(owner, (int)(tag & TC_CLASS_MASK), ptr);
+    } else {
+        __tc_remote_free(owner, ptr);
     }
 }
 
@@ -84,7 +567,32 @@ void tkl_system_free(void* ptr)
  */
 void *tkl_system_calloc(size_t nitems, size_t size)
 {
-    return tuya_mem_heap_calloc(s_heap_handle, nitems * size);
+    void *ptr = NULL;
+
+    if (size && nitems > SIZE_MAX / size) {
+        return NULL;
+    }
+
+    pthread_once(&s_heap_once, __heap_init);
+
+#if defined(ENABLE_MEM_PROF) && (ENABLE_MEM_PROF == 1)
+    uint32_t weight = __prof_sample();
+    if (weight) {
+        return __prof_malloc(nitems * size, TRUE, PROF_CALLER(), weight);
+    }
+#endif
+
+    // big blocks come from the heap, which knows what is zero already
+    if (nitems * size > TC_MAX_SIZE) {
+        return __direct_malloc(nitems * size, TRUE);
+    }
+
+    ptr = __system_malloc(nitems * size, PROF_CALLER());
+    if (ptr) {
+        memset(ptr, 0, nitems * size);
+    }
+
+    return ptr;
 }
 
 /**
@@ -95,7 +603,99 @@ void *tkl_system_calloc(size_t nitems, size_t size)
  */
 void *tkl_system_realloc(void* ptr, size_t size)
 {
-    return tuya_mem_heap_realloc(s_heap_handle, ptr, size);
+    uintptr_t tag = 0;
+    uint8_t *block = NULL;
+    void *tmp = NULL;
+    size_t old_size = 0;
+
+    pthread_once(&s_heap_once, __heap_init);
+
+    if (NULL == ptr) {
+        return __system_malloc(size, PROF_CALLER());
+    }
+
+    tag = TC_TAG(ptr);
+    if (TC_TAG_DIRECT == tag) {
+        if (size > (size_t)(UINT32_MAX - TC_TAG_SIZE)) {
+            return NULL;
+        }
+        block = tuya_mem_heap_realloc(s_heap_handle, (uint8_t *)ptr - TC_TAG_SIZE, size + TC_TAG_SIZE);
+        if (NULL == block && 0 == __heap_grow(size + TC_TAG_SIZE)) {
+            block = tuya_mem_heap_realloc(s_heap_handle, (uint8_t *)ptr - TC_TAG_SIZE, size + TC_TAG_SIZE);
+        }
+        return block ? block + TC_TAG_SIZE : NULL;
+    }
+
+#if defined(ENABLE_MEM_PROF) && (ENABLE_MEM_PROF == 1)
+    if (TC_TAG_PROF == tag) {
+        return __prof_realloc(ptr, size, PROF_CALLER());
+    }
+#endif
+
+    old_size = s_tc_class_size[tag & TC_CLASS_MASK];
+    if (size <= old_size) {
+        return ptr;
+    }
+
+    tmp = __system_malloc(size, PROF_CALLER());
+    if (NULL == tmp) {
+        return NULL;
+    }
+
+    memcpy(tmp, ptr, old_size);
+    tkl_system_free(ptr);
+    return tmp;
+}
+
+/**
+* @brief Alloc memory of system with the given alignment
+*
+* @param[in] size: memory size
+* @param[in] align: alignment of the memory address, a power of two
+*
+* @note The block comes straight from the heap without a tag word, so it
+*       bypasses the thread cache and must be freed by tkl_system_free_aligned.
+*
+* @return the memory address malloced, NULL on error
+*/
+void *tkl_system_malloc_aligned(SIZE_T size, SIZE_T align)
+{
+    void *ptr = NULL;
+
+    if (0 == align || (align & (align - 1)) || align > UINT32_MAX ||
+        size > (size_t)UINT32_MAX - align) {
+        return NULL;
+    }
+
+    pthread_once(&s_heap_once, __heap_init);
+
+    // the heap refuses 0, hand out a minimal block like tkl_system_malloc
+    if (0 == size) {
+        size = 1;
+    }
+
+    ptr = tuya_mem_heap_malloc_aligned(s_heap_handle, size, align);
+    if (NULL == ptr && 0 == __heap_grow(size + align)) {
+        ptr = tuya_mem_heap_malloc_aligned(s_heap_handle, size, align);
+    }
+
+    return ptr;
+}
+
+/**
+* @brief Free memory alloced by tkl_system_malloc_aligned
+*
+* @param[in] ptr: memory point
+*
+* @return void
+*/
+void tkl_system_free_aligned(void* ptr)
+{
+    if (NULL == ptr) {
+        return;
+    }
+
+    tuya_mem_heap_free(s_heap_handle, ptr);
 }
 
 /**
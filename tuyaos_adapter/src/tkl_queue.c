@@ -13,9 +13,102 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* TKL_QUEUE_FLAG_STATS, updated with relaxed atomics, the depth is derived from the counts */
+typedef struct queue_stat_t {
+    struct queue_stat_t *next;
+    TKL_QUEUE_STAT_T pub;
+} queue_stat_t;
+
+static pthread_mutex_t s_queue_stat_lock = PTHREAD_MUTEX_INITIALIZER;
+static queue_stat_t *s_queue_stat_list = NULL;
+
+static uint64_t queue_stat_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+/* a post or fetch that found the queue full or empty and waited since start */
+static void queue_stat_wait(queue_stat_t *stat, int producer, uint64_t start)
+{
+    uint64_t us = queue_stat_now() - start;
+    uint32_t idx = us ? (64 - __builtin_clzll(us)) : 0;
+
+    if (idx >= TKL_QUEUE_WAIT_HIST_NUM) {
+        idx = TKL_QUEUE_WAIT_HIST_NUM - 1;
+    }
+
+    if (producer) {
+        __atomic_add_fetch(&stat->pub.full_cnt, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stat->pub.post_wait_hist[idx], 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&stat->pub.empty_cnt, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stat->pub.fetch_wait_hist[idx], 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* n messages posted or fetched */
+static void queue_stat_move(queue_stat_t *stat, int producer, uint32_t n)
+{
+    uint64_t post = 0;
+    int64_t depth = 0;
+    uint32_t peak = 0;
+
+    if (NULL == stat || 0 == n) {
+        return;
+    }
+
+    if (!producer) {
+        __atomic_add_fetch(&stat->pub.fetch_cnt, n, __ATOMIC_RELAXED);
+        return;
+    }
+
+    post = __atomic_add_fetch(&stat->pub.post_cnt, n, __ATOMIC_RELAXED);
+    depth = (int64_t)(post - __atomic_load_n(&stat->pub.fetch_cnt, __ATOMIC_RELAXED));
+    if (depth > stat->pub.capacity) {
+        depth = stat->pub.capacity; // a fetch done but not counted yet
+    }
+
+    peak = __atomic_load_n(&stat->pub.peak_depth, __ATOMIC_RELAXED);
+    while (depth > peak &&
+           !__atomic_compare_exchange_n(&stat->pub.peak_depth, &peak, (uint32_t)depth, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* called with s_queue_stat_lock held */
+static void queue_stat_read(queue_stat_t *stat, TKL_QUEUE_STAT_T *out)
+{
+    int64_t depth = 0;
+    int i = 0;
+
+    memcpy(out->name, stat->pub.name, sizeof(out->name));
+    out->capacity = stat->pub.capacity;
+    out->peak_depth = __atomic_load_n(&stat->pub.peak_depth, __ATOMIC_RELAXED);
+    out->fetch_cnt = __atomic_load_n(&stat->pub.fetch_cnt, __ATOMIC_RELAXED);
+    out->post_cnt = __atomic_load_n(&stat->pub.post_cnt, __ATOMIC_RELAXED);
+    out->full_cnt = __atomic_load_n(&stat->pub.full_cnt, __ATOMIC_RELAXED);
+    out->empty_cnt = __atomic_load_n(&stat->pub.empty_cnt, __ATOMIC_RELAXED);
+    for (i = 0; i < TKL_QUEUE_WAIT_HIST_NUM; i++) {
+        out->post_wait_hist[i] = __atomic_load_n(&stat->pub.post_wait_hist[i], __ATOMIC_RELAXED);
+        out->fetch_wait_hist[i] = __atomic_load_n(&stat->pub.fetch_wait_hist[i], __ATOMIC_RELAXED);
+    }
+
+    depth = (int64_t)(out->post_cnt - out->fetch_cnt);
+    out->depth = (depth < 0) ? 0 : (depth > out->capacity) ? out->capacity : (uint32_t)depth;
+}
 
 typedef struct rpa_queue_t {
     void **data;
+    uint8_t *slots;          /**< inline message storage, NULL to queue pointers */
+    uint32_t msgsize;        /**< size of an inline slot */
     volatile uint32_t nelts; /**< # elements */
     uint32_t in;             /**< next empty location */
     uint32_t out;            /**< next filled location */
@@ -26,10 +119,26 @@ typedef struct rpa_queue_t {
     pthread_cond_t *not_empty;
     pthread_cond_t *not_full;
     int terminated;
+    queue_stat_t *stat;      /**< NULL without TKL_QUEUE_FLAG_STATS */
+
+    /* priority mode, the slots are linked into one FIFO list per level and a free list */
+    uint32_t levels;         /**< 0 for a plain ring */
+    uint32_t aging;          /**< fetches a message may be passed over, 0 never ages */
+    uint32_t pops;           /**< fetches so far, the clock of the aging */
+    uint32_t free_head;
+    uint32_t *link;          /**< next slot of a list, per slot */
+    uint32_t *stamp;         /**< pops when queued, per slot */
+    uint32_t *head;          /**< per level */
+    uint32_t *tail;          /**< per level */
 } rpa_queue_t;
 
 #define RPA_WAIT_NONE    0
 #define RPA_WAIT_FOREVER -1
+#define RPA_NIL          0xFFFFFFFFu
+
+#ifndef TKL_QUEUE_PRIO_AGING_FETCHES
+#define TKL_QUEUE_PRIO_AGING_FETCHES    64  /* fetches of higher levels a message waits at most with TKL_QUEUE_FLAG_AGING */
+#endif
 
 #define rpa_queue_full(queue)  ((queue)->nelts == (queue)->bounds)
 #define rpa_queue_empty(queue) ((queue)->nelts == 0)
@@ -49,15 +158,39 @@ static void set_timeout(struct timespec *abstime, int wait_ms)
     abstime->tv_nsec = ms * 1000000L;
 }
 
+static void rpa_queue_get(rpa_queue_t *queue, void **data);
+
 static void rpa_queue_destroy(rpa_queue_t *queue)
 {
+    void *msg = NULL;
+
     /* Ignore errors here, we can't do anything about them anyway. */
     pthread_cond_destroy(queue->not_empty);
     pthread_cond_destroy(queue->not_full);
     pthread_mutex_destroy(queue->one_big_mutex);
+
+    /* messages still queued by pointer are owned by the queue */
+    if (NULL == queue->slots) {
+        while (!rpa_queue_empty(queue)) {
+            rpa_queue_get(queue, &msg);
+            free(msg);
+        }
+    }
+
+    free(queue->not_empty);
+    free(queue->not_full);
+    free(queue->one_big_mutex);
+    free(queue->data);
+    free(queue->slots);
+    free(queue->link);
+    free(queue);
 }
 
-static BOOL_T rpa_queue_create(rpa_queue_t **q, uint32_t queue_capacity)
+/*
+ * msgsize 0 queues pointers, otherwise messages are copied into inline slots,
+ * levels above 1 fetch the highest level first
+ */
+static BOOL_T rpa_queue_create(rpa_queue_t **q, uint32_t queue_capacity, uint32_t msgsize, uint32_t levels, uint32_t aging)
 {
     rpa_queue_t *queue;
     queue = malloc(sizeof(rpa_queue_t));
@@ -68,11 +201,11 @@ static BOOL_T rpa_queue_create(rpa_queue_t **q, uint32_t queue_capacity)
     memset(queue, 0, sizeof(rpa_queue_t));
 
     if (!(queue->one_big_mutex = malloc(sizeof(pthread_mutex_t))))
-        return false;
+        goto error;
     if (!(queue->not_empty = malloc(sizeof(pthread_cond_t))))
-        return false;
+        goto error;
     if (!(queue->not_full = malloc(sizeof(pthread_cond_t))))
-        return false;
+        goto error;
 
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
@@ -93,7 +226,35 @@ static BOOL_T rpa_queue_create(rpa_queue_t **q, uint32_t queue_capacity)
     }
 
     /* Set all the data in the queue to NULL */
-    queue->data          = malloc(queue_capacity * sizeof(void *));
+    if (msgsize) {
+        queue->slots     = malloc((size_t)queue_capacity * msgsize);
+        if (!queue->slots) {
+            goto error;
+        }
+    } else {
+        queue->data      = malloc(queue_capacity * sizeof(void *));
+        if (!queue->data) {
+            goto error;
+        }
+    }
+    if (levels > 1) {
+        queue->link = malloc((2 * (size_t)queue_capacity + 2 * levels) * sizeof(uint32_t));
+        if (!queue->link) {
+            goto error;
+        }
+        queue->stamp = queue->link + queue_capacity;
+        queue->head  = queue->stamp + queue_capacity;
+        queue->tail  = queue->head + levels;
+        for (uint32_t i = 0; i < queue_capacity; i++) {
+            queue->link[i] = i + 1;
+        }
+        queue->link[queue_capacity - 1] = RPA_NIL;
+        memset(queue->head, 0xFF, 2 * levels * sizeof(uint32_t));
+        queue->free_head = 0;
+        queue->levels    = levels;
+        queue->aging     = aging;
+    }
+    queue->msgsize       = msgsize;
     queue->bounds        = queue_capacity;
     queue->nelts         = 0;
     queue->in            = 0;
@@ -105,11 +266,109 @@ static BOOL_T rpa_queue_create(rpa_queue_t **q, uint32_t queue_capacity)
     return true;
 
 error:
+    free(queue->not_empty);
+    free(queue->not_full);
+    free(queue->one_big_mutex);
+    free(queue->data);
+    free(queue->slots);
     free(queue);
     return false;
 }
 
-static BOOL_T rpa_queue_trypush(rpa_queue_t *queue, void *data)
+/* called locked, the level to fetch from, an aged message beats the highest level */
+static uint32_t rpa_queue_level(rpa_queue_t *queue)
+{
+    uint32_t level = queue->levels - 1;
+    uint32_t pick = 0;
+    uint32_t age = 0, oldest = 0;
+
+    while (RPA_NIL == queue->head[level]) {
+        level--;
+    }
+    pick = level;
+
+    if (queue->aging) {
+        while (level-- > 0) {
+            if (RPA_NIL == queue->head[level]) {
+                continue;
+            }
+            age = queue->pops - queue->stamp[queue->head[level]];
+            if (age >= queue->aging && age > oldest) {
+                oldest = age;
+                pick = level;
+            }
+        }
+    }
+
+    return pick;
+}
+
+/* called locked, the queue is not full, prio is ignored by a plain ring */
+static void rpa_queue_put(rpa_queue_t *queue, void *data, uint32_t prio)
+{
+    uint32_t idx = queue->in;
+
+    if (queue->levels) {
+        if (prio >= queue->levels) {
+            prio = queue->levels - 1;
+        }
+        idx = queue->free_head;
+        queue->free_head = queue->link[idx];
+        queue->link[idx] = RPA_NIL;
+        queue->stamp[idx] = queue->pops;
+        if (RPA_NIL == queue->tail[prio]) {
+            queue->head[prio] = idx;
+        } else {
+            queue->link[queue->tail[prio]] = idx;
+        }
+        queue->tail[prio] = idx;
+    } else {
+        queue->in++;
+        if (queue->in >= queue->bounds) {
+            queue->in -= queue->bounds;
+        }
+    }
+
+    if (queue->slots) {
+        memcpy(queue->slots + (size_t)idx * queue->msgsize, data, queue->msgsize);
+    } else {
+        queue->data[idx] = data;
+    }
+    queue->nelts++;
+}
+
+/* called locked, the queue is not empty, an inline message is copied to data itself */
+static void rpa_queue_get(rpa_queue_t *queue, void **data)
+{
+    uint32_t idx = queue->out;
+    uint32_t level = 0;
+
+    if (queue->levels) {
+        level = rpa_queue_level(queue);
+        idx = queue->head[level];
+        queue->head[level] = queue->link[idx];
+        if (RPA_NIL == queue->head[level]) {
+            queue->tail[level] = RPA_NIL;
+        }
+        queue->link[idx] = queue->free_head;
+        queue->free_head = idx;
+        queue->pops++;
+    } else {
+        queue->out++;
+        if (queue->out >= queue->bounds) {
+            queue->out -= queue->bounds;
+        }
+    }
+
+    if (queue->slots) {
+        memcpy(data, queue->slots + (size_t)idx * queue->msgsize, queue->msgsize);
+    } else {
+        *data = queue->data[idx];
+    }
+    queue->nelts--;
+}
+
+static BOOL_T rpa_queue_trypush(rpa_queue_t *queue, void *data, uint32_t prio)
 {
     BOOL_T rv;
 
@@ -127,12 +386,7 @@ static BOOL_T rpa_queue_trypush(rpa_queue_t *queue, void *data)
         return false; // EAGAIN;
     }
 
-    queue->data[queue->in] = data;
-    queue->in++;
-    if (queue->in >= queue->bounds) {
-        queue->in -= queue->bounds;
-    }
-    queue->nelts++;
+    rpa_queue_put(queue, data, prio);
 
     if (queue->empty_waiters) {
         rv = pthread_cond_signal(queue->not_empty);
@@ -146,12 +400,13 @@ static BOOL_T rpa_queue_trypush(rpa_queue_t *queue, void *data)
     return true;
 }
 
-static BOOL_T rpa_queue_timedpush(rpa_queue_t *queue, void *data, int wait_ms)
+static BOOL_T rpa_queue_timedpush(rpa_queue_t *queue, void *data, uint32_t prio, int wait_ms)
 {
+    uint64_t start = 0;
     BOOL_T rv;
 
     if (wait_ms == RPA_WAIT_NONE)
-        return rpa_queue_trypush(queue, data);
+        return rpa_queue_trypush(queue, data, prio);
 
     if (queue->terminated) {
         return false; /* no more elements ever again */
@@ -165,6 +420,7 @@ static BOOL_T rpa_queue_timedpush(rpa_queue_t *queue, void *data, int wait_ms)
     if (rpa_queue_full(queue)) {
         if (!queue->terminated) {
             queue->full_waiters++;
+            start = queue->stat ? queue_stat_now() : 0;
             if (wait_ms == RPA_WAIT_FOREVER) {
                 rv = pthread_cond_wait(queue->not_full, queue->one_big_mutex);
             } else {
@@ -174,6 +430,9 @@ static BOOL_T rpa_queue_timedpush(rpa_queue_t *queue, void *data, int wait_ms)
                                             &abstime);
             }
             queue->full_waiters--;
+            if (queue->stat) {
+                queue_stat_wait(queue->stat, TRUE, start);
+            }
             if (rv != 0) {
                 pthread_mutex_unlock(queue->one_big_mutex);
                 return false;
@@ -193,12 +452,7 @@ static BOOL_T rpa_queue_timedpush(rpa_queue_t *queue, void *data, int wait_ms)
         }
     }
 
-    queue->data[queue->in] = data;
-    queue->in++;
-    if (queue->in >= queue->bounds) {
-        queue->in -= queue->bounds;
-    }
-    queue->nelts++;
+    rpa_queue_put(queue, data, prio);
 
     if (queue->empty_waiters) {
         rv = pthread_cond_signal(queue->not_empty);
@@ -230,13 +484,7 @@ static BOOL_T rpa_queue_trypop(rpa_queue_t *queue, void **data)
         return false; // EAGAIN;
     }
 
-    *data = queue->data[queue->out];
-    queue->nelts--;
-
-    queue->out++;
-    if (queue->out >= queue->bounds) {
-        queue->out -= queue->bounds;
-    }
+    rpa_queue_get(queue, data);
     if (queue->full_waiters) {
         rv = pthread_cond_signal(queue->not_full);
         if (rv != 0) {
@@ -251,6 +499,7 @@ static BOOL_T rpa_queue_trypop(rpa_queue_t *queue, void **data)
 
 static BOOL_T rpa_queue_timedpop(rpa_queue_t *queue, void **data, int wait_ms)
 {
+    uint64_t start = 0;
     BOOL_T rv;
 
     if (wait_ms == RPA_WAIT_NONE)
@@ -269,6 +518,7 @@ static BOOL_T rpa_queue_timedpop(rpa_queue_t *queue, void **data, int wait_ms)
     if (rpa_queue_empty(queue)) {
         if (!queue->terminated) {
             queue->empty_waiters++;
+            start = queue->stat ? queue_stat_now() : 0;
             if (wait_ms == RPA_WAIT_FOREVER) {
                 rv = pthread_cond_wait(queue->not_empty, queue->one_big_mutex);
             } else {
@@ -278,6 +528,9 @@ static BOOL_T rpa_queue_timedpop(rpa_queue_t *queue, void **data, int wait_ms)
                                             &abstime);
             }
             queue->empty_waiters--;
+            if (queue->stat) {
+                queue_stat_wait(queue->stat, FALSE, start);
+            }
             if (rv != 0) {
                 pthread_mutex_unlock(queue->one_big_mutex);
                 return false;
@@ -297,13 +550,7 @@ static BOOL_T rpa_queue_timedpop(rpa_queue_t *queue, void **data, int wait_ms)
         }
     }
 
-    *data = queue->data[queue->out];
-    queue->nelts--;
-
-    queue->out++;
-    if (queue->out >= queue->bounds) {
-        queue->out -= queue->bounds;
-    }
+    rpa_queue_get(queue, data);
     if (queue->full_waiters) {
         rv = pthread_cond_signal(queue->not_full);
         if (rv != 0) {
@@ -316,132 +563,1065 @@ static BOOL_T rpa_queue_timedpop(rpa_queue_t *queue, void **data, int wait_ms)
     return true;
 }
 
-typedef struct {
-    rpa_queue_t *queue;
-    int msgsize;
-} TKL_QUEUE_T;
+/* the address of message i of a batch, a message in inline mode and a pointer otherwise */
+#define RPA_BATCH_AT(queue, items, i) \
+    ((uint8_t *)(items) + (size_t)(i) * ((queue)->slots ? (queue)->msgsize : sizeof(void *)))
 
-/**
- * @brief Create message queue
- *
- * @param[in] msgsize message size
- * @param[in] msgcount message number
- * @param[out] queue the queue handle created
- *
- * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+/*
+ * wait like rpa_queue_timedpush until the queue is not full, then push as
+ * many of the count messages as fit under the same lock with one wakeup,
+ * returns the number pushed
  */
-TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_create_init(TKL_QUEUE_HANDLE *handle, int msgsize, int msgcount)
+static uint32_t rpa_queue_timedpush_batch(rpa_queue_t *queue, void *items, uint32_t count, int wait_ms)
 {
-    TKL_QUEUE_T *queue = NULL;
+    uint64_t start = 0;
+    uint32_t n = 0;
+    uint8_t *at = NULL;
+    int rv;
 
-    if ((NULL == handle) || (0 == msgsize) || (0 == msgcount)) {
-        return OPRT_INVALID_PARM;
+    if (queue->terminated) {
+        return 0; /* no more elements ever again */
     }
 
-    queue = (TKL_QUEUE_T *)malloc(sizeof(TKL_QUEUE_T));
-    if (!queue) {
-        return OPRT_MALLOC_FAILED;
+    rv = pthread_mutex_lock(queue->one_big_mutex);
+    if (rv != 0) {
+        return 0;
     }
 
-    if (!rpa_queue_create(&queue->queue, msgcount)) {
-        return OPRT_OS_ADAPTER_QUEUE_CREAT_FAILED;
+    if (rpa_queue_full(queue) && wait_ms != RPA_WAIT_NONE && !queue->terminated) {
+        queue->full_waiters++;
+        start = queue->stat ? queue_stat_now() : 0;
+        if (wait_ms == RPA_WAIT_FOREVER) {
+            rv = pthread_cond_wait(queue->not_full, queue->one_big_mutex);
+        } else {
+            struct timespec abstime;
+            set_timeout(&abstime, wait_ms);
+            rv = pthread_cond_timedwait(queue->not_full, queue->one_big_mutex, &abstime);
+        }
+        queue->full_waiters--;
+        if (queue->stat) {
+            queue_stat_wait(queue->stat, TRUE, start);
+        }
     }
-    queue->msgsize = msgsize;
 
-    *handle = (TKL_QUEUE_HANDLE)queue;
+    for (n = 0; n < count && !rpa_queue_full(queue); n++) {
+        at = RPA_BATCH_AT(queue, items, n);
+        rpa_queue_put(queue, queue->slots ? (void *)at : *(void **)at, 0);
+    }
 
-    return OPRT_OK;
+    if (n && queue->empty_waiters) {
+        if (n > 1) {
+            pthread_cond_broadcast(queue->not_empty);
+        } else {
+            pthread_cond_signal(queue->not_empty);
+        }
+    }
+
+    pthread_mutex_unlock(queue->one_big_mutex);
+    return n;
 }
 
-/**
- * @brief post a message to the message queue
- *
- * @param[in] queue the handle of the queue
- * @param[in] data the data of the message
- * @param[in] timeout timeout time
- *
- * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+/*
+ * wait like rpa_queue_timedpop until the queue is not empty, then pop up to
+ * max messages under the same lock with one wakeup, returns the number popped
  */
-TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_post(const TKL_QUEUE_HANDLE handle, void *data, uint32_t timeout)
+static uint32_t rpa_queue_timedpop_batch(rpa_queue_t *queue, void *items, uint32_t max, int wait_ms)
 {
-    if (NULL == handle || NULL == data) {
-        return OPRT_INVALID_PARM;
-    }
+    uint64_t start = 0;
+    uint32_t n = 0;
+    int rv;
 
-    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
-    int wait_ms      = 0;
+    if (queue->terminated) {
+        return 0; /* no more elements ever again */
+    }
 
-    void *buf = (void *)malloc(queue->msgsize);
-    if (NULL == buf) {
-        return OPRT_MALLOC_FAILED;
+    rv = pthread_mutex_lock(queue->one_big_mutex);
+    if (rv != 0) {
+        return 0;
     }
 
-    memcpy(buf, (void *)data, queue->msgsize);
+    if (rpa_queue_empty(queue) && wait_ms != RPA_WAIT_NONE && !queue->terminated) {
+        queue->empty_waiters++;
+        start = queue->stat ? queue_stat_now() : 0;
+        if (wait_ms == RPA_WAIT_FOREVER) {
+            rv = pthread_cond_wait(queue->not_empty, queue->one_big_mutex);
+        } else {
+            struct timespec abstime;
+            set_timeout(&abstime, wait_ms);
+            rv = pthread_cond_timedwait(queue->not_empty, queue->one_big_mutex, &abstime);
+        }
+        queue->empty_waiters--;
+        if (queue->stat) {
+            queue_stat_wait(queue->stat, FALSE, start);
+        }
+    }
 
-    if (timeout == TKL_QUEUE_WAIT_FROEVER) {
-        wait_ms = RPA_WAIT_FOREVER;
-    } else {
-        wait_ms = timeout;
+    for (n = 0; n < max && !rpa_queue_empty(queue); n++) {
+        rpa_queue_get(queue, (void **)RPA_BATCH_AT(queue, items, n));
     }
 
-    if (!rpa_queue_timedpush(queue->queue, buf, wait_ms)) {
-        return OPRT_OS_ADAPTER_QUEUE_SEND_FAIL;
+    if (n && queue->full_waiters) {
+        if (n > 1) {
+            pthread_cond_broadcast(queue->not_full);
+        } else {
+            pthread_cond_signal(queue->not_full);
+        }
     }
 
-    return OPRT_OK;
+    pthread_mutex_unlock(queue->one_big_mutex);
+    return n;
 }
 
-/**
- * @brief fetch message from the message queue
- *
- * @param[in] queue the message queue handle
- * @param[inout] msg the message fetch form the message queue
- * @param[in] timeout timeout time
- *
- * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+/*
+ * lock-free bounded rings, TKL_QUEUE_FLAG_MPMC and TKL_QUEUE_FLAG_SPSC
+ * the MPMC ring gives every cell a sequence number telling whose turn it is
+ * (D. Vyukov's bounded MPMC queue), the SPSC ring only needs the two indexes.
+ * Messages live inline in the cells, the capacity is rounded up to a power of
+ * two. Threads only sleep on a futex when the ring is empty or full.
  */
-TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_fetch(const TKL_QUEUE_HANDLE handle, void *msg, uint32_t timeout)
+#define LF_CACHE_LINE   64
+#define LF_SPIN         256     /* retries before sleeping, the other side is often just behind */
+#if defined(__x86_64__) || defined(__i386__)
+#define LF_CPU_RELAX()  __builtin_ia32_pause()
+#elif defined(__aarch64__) || (defined(__arm__) && (__ARM_ARCH >= 7))
+#define LF_CPU_RELAX()  __asm__ __volatile__("yield" ::: "memory")
+#else
+#define LF_CPU_RELAX()  __asm__ __volatile__("" ::: "memory")
+#endif
+#define LF_HEAD         8       /* MPMC cell header holding the sequence word, keeps messages 8 byte aligned */
+#define LF_ALIGN(x)     (((x) + LF_HEAD - 1) & ~(LF_HEAD - 1))
+
+typedef struct {
+    uint32_t seq;           /**< bumped on a signal finding waiters, the futex word */
+    uint32_t waiters;       /**< set by a thread going to sleep, cleared by the signal waking it */
+} lf_event_t;
+
+typedef struct lf_queue_t {
+    uint8_t *cells;
+    uint32_t mask;
+    uint32_t stride;        /**< cell size, the MPMC sequence word in front of the message */
+    uint32_t msgsize;
+    int spsc;
+    int spin;               /**< retries before sleeping, 0 on a single cpu */
+    queue_stat_t *stat;     /**< NULL without TKL_QUEUE_FLAG_STATS */
+
+    uint32_t enqueue_pos __attribute__((aligned(LF_CACHE_LINE)));
+    uint32_t dequeue_pos __attribute__((aligned(LF_CACHE_LINE)));
+    lf_event_t not_empty __attribute__((aligned(LF_CACHE_LINE)));
+    lf_event_t not_full;
+} lf_queue_t;
+
+#define LF_CELL(queue, pos)     ((queue)->cells + (size_t)((pos) & (queue)->mask) * (queue)->stride)
+#define LF_CELL_SEQ(cell)       ((uint32_t *)(cell))
+
+static BOOL_T lf_queue_create(lf_queue_t **q, uint32_t queue_capacity, uint32_t msgsize, int spsc)
 {
-    if (NULL == handle) {
-        return OPRT_INVALID_PARM;
+    lf_queue_t *queue = NULL;
+    uint32_t capacity = 1;
+    uint32_t i = 0;
+
+    while (capacity < queue_capacity) {
+        capacity <<= 1;
+        if (0 == capacity) {
+            return false;
+        }
     }
 
-    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
-    void *buf        = NULL;
-    int wait_ms;
+    if (posix_memalign((void **)&queue, LF_CACHE_LINE, sizeof(lf_queue_t))) {
+        return false;
+    }
+    memset(queue, 0, sizeof(lf_queue_t));
 
-    if (timeout == TKL_QUEUE_WAIT_FROEVER) {
-        wait_ms = RPA_WAIT_FOREVER;
-    } else {
-        wait_ms = timeout;
+    queue->spsc = spsc;
+    queue->spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? LF_SPIN : 0;
+    queue->msgsize = msgsize;
+    queue->mask = capacity - 1;
+    queue->stride = LF_ALIGN(msgsize) + (spsc ? 0 : LF_HEAD);
+    queue->cells = malloc((size_t)capacity * queue->stride);
+    if (NULL == queue->cells) {
+        free(queue);
+        return false;
     }
 
-    if (!rpa_queue_timedpop(queue->queue, (void **)&buf, wait_ms)) {
-        return OPRT_OS_ADAPTER_QUEUE_RECV_FAIL;
+    if (!spsc) {
+        for (i = 0; i < capacity; i++) {
+            *LF_CELL_SEQ(LF_CELL(queue, i)) = i;
+        }
     }
 
-    if (buf) {
-        memcpy((void *)msg, buf, queue->msgsize);
-        free(buf);
+    *q = queue;
+    return true;
+}
+
+static void lf_queue_destroy(lf_queue_t *queue)
+{
+    free(queue->cells);
+    free(queue);
+}
+
+/* claim the next free cell for the producer, NULL if the ring is full */
+static uint8_t *lf_queue_claim_in(lf_queue_t *queue)
+{
+    uint32_t pos = 0;
+    uint32_t seq = 0;
+    uint8_t *cell = NULL;
+    int32_t diff = 0;
+
+    if (queue->spsc) {
+        pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+        if (pos - __atomic_load_n(&queue->dequeue_pos, __ATOMIC_ACQUIRE) > queue->mask) {
+            return NULL;
+        }
+        return LF_CELL(queue, pos);
     }
 
-    return OPRT_OK;
+    pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = LF_CELL(queue, pos);
+        seq = __atomic_load_n(LF_CELL_SEQ(cell), __ATOMIC_ACQUIRE);
+        diff = (int32_t)(seq - pos);
+        if (0 == diff) {
+            if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                return cell + LF_HEAD;
+            }
+        } else if (diff < 0) {
+            return NULL; // the cell still holds the message of the last lap
+        } else {
+            pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
 }
 
-/**
- * @brief free the message queue
- *
- * @param[in] queue the message queue handle
- *
- * @return void
- */
-TUYA_WEAK_ATTRIBUTE void tkl_queue_free(const TKL_QUEUE_HANDLE handle)
+/* hand a claimed cell to the consumers */
+static void lf_queue_publish_in(lf_queue_t *queue, uint8_t *msg)
 {
-    if (NULL == handle) {
+    uint32_t *seq = NULL;
+
+    if (queue->spsc) {
+        __atomic_store_n(&queue->enqueue_pos, queue->enqueue_pos + 1, __ATOMIC_RELEASE);
         return;
     }
 
-    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
-    rpa_queue_destroy(queue->queue);
-    free(queue);
+    // nobody else touches the cell until this store, its seq is still the claimed pos
+    seq = LF_CELL_SEQ(msg - LF_HEAD);
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+/* claim the oldest posted cell for the consumer, NULL if the ring is empty */
+static uint8_t *lf_queue_claim_out(lf_queue_t *queue)
+{
+    uint32_t pos = 0;
+    uint32_t seq = 0;
+    uint8_t *cell = NULL;
+    int32_t diff = 0;
+
+    if (queue->spsc) {
+        pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+        if (pos == __atomic_load_n(&queue->enqueue_pos, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+        return LF_CELL(queue, pos);
+    }
+
+    pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = LF_CELL(queue, pos);
+        seq = __atomic_load_n(LF_CELL_SEQ(cell), __ATOMIC_ACQUIRE);
+        diff = (int32_t)(seq - (pos + 1));
+        if (0 == diff) {
+            if (__atomic_compare_exchange_n(&queue->dequeue_pos, &pos, pos + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                return cell + LF_HEAD;
+            }
+        } else if (diff < 0) {
+            return NULL; // nothing posted to the cell yet
+        } else {
+            pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* give a claimed cell back to the producers for the next lap */
+static void lf_queue_publish_out(lf_queue_t *queue, uint8_t *msg)
+{
+    uint32_t *seq = NULL;
+
+    if (queue->spsc) {
+        __atomic_store_n(&queue->dequeue_pos, queue->dequeue_pos + 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    seq = LF_CELL_SEQ(msg - LF_HEAD);
+    __atomic_store_n(seq, *seq + queue->mask, __ATOMIC_RELEASE);
+}
+
+static BOOL_T lf_queue_trypush(lf_queue_t *queue, void *data)
+{
+    uint8_t *msg = lf_queue_claim_in(queue);
+
+    if (NULL == msg) {
+        return false;
+    }
+
+    memcpy(msg, data, queue->msgsize);
+    lf_queue_publish_in(queue, msg);
+    return true;
+}
+
+static BOOL_T lf_queue_trypop(lf_queue_t *queue, void *data)
+{
+    uint8_t *msg = lf_queue_claim_out(queue);
+
+    if (NULL == msg) {
+        return false;
+    }
+
+    memcpy(data, msg, queue->msgsize);
+    lf_queue_publish_out(queue, msg);
+    return true;
+}
+
+/* the loan ops hand out the claimed cell in *data instead of copying */
+static BOOL_T lf_queue_tryloan(lf_queue_t *queue, void *data)
+{
+    *(uint8_t **)data = lf_queue_claim_in(queue);
+    return (NULL != *(uint8_t **)data);
+}
+
+static BOOL_T lf_queue_tryborrow(lf_queue_t *queue, void *data)
+{
+    *(uint8_t **)data = lf_queue_claim_out(queue);
+    return (NULL != *(uint8_t **)data);
+}
+
+/*
+ * the waiters that were woken check the ring again and sleep again when they
+ * lose, so the common post or fetch only costs a fence and a load here
+ */
+static void lf_event_signal(lf_event_t *event)
+{
+    // pairs with the waiter registering before it checks the ring again
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&event->waiters, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&event->waiters, 0, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&event->seq, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &event->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+/* retry op after it failed until it succeeds or wait_ms passed, sleeping on event */
+static BOOL_T lf_queue_block(lf_queue_t *queue, BOOL_T (*op)(lf_queue_t *, void *), void *data,
+                             lf_event_t *event, int wait_ms)
+{
+    struct timespec end, now, left;
+    struct timespec *timeout = NULL;
+    uint32_t seq = 0;
+    int spin = 0;
+
+    for (spin = 0; spin < queue->spin; spin++) {
+        LF_CPU_RELAX();
+        if (op(queue, data)) {
+            return true;
+        }
+    }
+
+    if (wait_ms != RPA_WAIT_FOREVER) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        end.tv_sec += wait_ms / 1000;
+        end.tv_nsec += (wait_ms % 1000) * 1000000L;
+        if (end.tv_nsec >= 1000000000L) {
+            end.tv_sec++;
+            end.tv_nsec -= 1000000000L;
+        }
+        timeout = &left;
+    }
+
+    for (;;) {
+        seq = __atomic_load_n(&event->seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&event->waiters, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        // a flag left set only costs the next signal a wakeup of nobody
+        if (op(queue, data)) {
+            return true;
+        }
+
+        if (timeout) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            left.tv_sec = end.tv_sec - now.tv_sec;
+            left.tv_nsec = end.tv_nsec - now.tv_nsec;
+            if (left.tv_nsec < 0) {
+                left.tv_sec--;
+                left.tv_nsec += 1000000000L;
+            }
+            if (left.tv_sec < 0) {
+                return false;
+            }
+        }
+
+        // returns at once if the event was signalled since seq was read
+        syscall(SYS_futex, &event->seq, FUTEX_WAIT_PRIVATE, seq, timeout, NULL, 0);
+    }
+}
+
+/*
+ * retry op until it succeeds or wait_ms passed, sleeping on event while the
+ * ring is empty or full, RPA_WAIT_NONE tries once
+ */
+static BOOL_T lf_queue_wait(lf_queue_t *queue, BOOL_T (*op)(lf_queue_t *, void *), void *data,
+                            lf_event_t *event, int wait_ms)
+{
+    uint64_t start = 0;
+    BOOL_T rv = false;
+
+    if (op(queue, data)) {
+        return true;
+    }
+    if (wait_ms == RPA_WAIT_NONE) {
+        return false;
+    }
+
+    start = queue->stat ? queue_stat_now() : 0;
+    rv = lf_queue_block(queue, op, data, event, wait_ms);
+    if (queue->stat) {
+        queue_stat_wait(queue->stat, event == &queue->not_full, start);
+    }
+
+    return rv;
+}
+
+static BOOL_T lf_queue_timedpush(lf_queue_t *queue, void *data, int wait_ms)
+{
+    if (!lf_queue_wait(queue, lf_queue_trypush, data, &queue->not_full, wait_ms)) {
+        return false;
+    }
+
+    lf_event_signal(&queue->not_empty);
+    return true;
+}
+
+static BOOL_T lf_queue_timedpop(lf_queue_t *queue, void *data, int wait_ms)
+{
+    if (!lf_queue_wait(queue, lf_queue_trypop, data, &queue->not_empty, wait_ms)) {
+        return false;
+    }
+
+    lf_event_signal(&queue->not_full);
+    return true;
+}
+
+/* the first message waits like lf_queue_timedpush, the rest are only tried, one wakeup for all */
+static uint32_t lf_queue_timedpush_batch(lf_queue_t *queue, void *items, uint32_t count, int wait_ms)
+{
+    uint32_t n = 0;
+
+    if (0 == count || !lf_queue_wait(queue, lf_queue_trypush, items, &queue->not_full, wait_ms)) {
+        return 0;
+    }
+
+    for (n = 1; n < count; n++) {
+        if (!lf_queue_trypush(queue, (uint8_t *)items + (size_t)n * queue->msgsize)) {
+            break;
+        }
+    }
+
+    lf_event_signal(&queue->not_empty);
+    return n;
+}
+
+static uint32_t lf_queue_timedpop_batch(lf_queue_t *queue, void *items, uint32_t max, int wait_ms)
+{
+    uint32_t n = 0;
+
+    if (0 == max || !lf_queue_wait(queue, lf_queue_trypop, items, &queue->not_empty, wait_ms)) {
+        return 0;
+    }
+
+    for (n = 1; n < max; n++) {
+        if (!lf_queue_trypop(queue, (uint8_t *)items + (size_t)n * queue->msgsize)) {
+            break;
+        }
+    }
+
+    lf_event_signal(&queue->not_full);
+    return n;
+}
+
+#define TKL_QUEUE_BATCH_PTRS    32  /* heap copies taken at a time by a batch fetch of a pointer queue */
+
+typedef struct {
+    rpa_queue_t *queue;
+    lf_queue_t *lf;         /**< set for TKL_QUEUE_FLAG_MPMC and TKL_QUEUE_FLAG_SPSC */
+    queue_stat_t *stat;     /**< set for TKL_QUEUE_FLAG_STATS, in s_queue_stat_list */
+    int msgsize;
+    uint32_t flags;
+} TKL_QUEUE_T;
+
+/**
+ * @brief Create message queue
+ *
+ * @param[in] msgsize message size
+ * @param[in] msgcount message number
+ * @param[out] queue the queue handle created
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_create_init(TKL_QUEUE_HANDLE *handle, int msgsize, int msgcount)
+{
+    return tkl_queue_create_init_ext(handle, msgsize, msgcount, 0);
+}
+
+/**
+ * @brief Create message queue with the given mode
+ *
+ * @param[out] queue the queue handle created
+ * @param[in] msgsize message size
+ * @param[in] msgcount message number
+ * @param[in] flags TKL_QUEUE_FLAG_XXX
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_create_init_ext(TKL_QUEUE_HANDLE *handle, int msgsize, int msgcount, uint32_t flags)
+{
+    TKL_QUEUE_T *queue = NULL;
+
+    if ((NULL == handle) || (msgsize <= 0) || (msgcount <= 0)) {
+        return OPRT_INVALID_PARM;
+    }
+    // the lock-free rings are strictly FIFO
+    if ((flags & (TKL_QUEUE_FLAG_MPMC | TKL_QUEUE_FLAG_SPSC)) && TKL_QUEUE_PRIO_LEVELS(flags) > 1) {
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    queue = (TKL_QUEUE_T *)malloc(sizeof(TKL_QUEUE_T));
+    if (!queue) {
+        return OPRT_MALLOC_FAILED;
+    }
+
+    memset(queue, 0, sizeof(TKL_QUEUE_T));
+
+    if (flags & (TKL_QUEUE_FLAG_MPMC | TKL_QUEUE_FLAG_SPSC)) {
+        if (!lf_queue_create(&queue->lf, msgcount, msgsize, (flags & TKL_QUEUE_FLAG_SPSC) ? 1 : 0)) {
+            free(queue);
+            return OPRT_OS_ADAPTER_QUEUE_CREAT_FAILED;
+        }
+    } else if (!rpa_queue_create(&queue->queue, msgcount, (flags & TKL_QUEUE_FLAG_INLINE) ? msgsize : 0,
+                                 TKL_QUEUE_PRIO_LEVELS(flags), (flags & TKL_QUEUE_FLAG_AGING) ? TKL_QUEUE_PRIO_AGING_FETCHES : 0)) {
+        free(queue);
+        return OPRT_OS_ADAPTER_QUEUE_CREAT_FAILED;
+    }
+    queue->msgsize = msgsize;
+    queue->flags = flags;
+
+    if (flags & TKL_QUEUE_FLAG_STATS) {
+        queue->stat = (queue_stat_t *)calloc(1, sizeof(queue_stat_t));
+        if (NULL == queue->stat) {
+            tkl_queue_free((TKL_QUEUE_HANDLE)queue);
+            return OPRT_MALLOC_FAILED;
+        }
+        if (queue->lf) {
+            queue->stat->pub.capacity = queue->lf->mask + 1;
+            queue->lf->stat = queue->stat;
+        } else {
+            queue->stat->pub.capacity = queue->queue->bounds;
+            queue->queue->stat = queue->stat;
+        }
+
+        pthread_mutex_lock(&s_queue_stat_lock);
+        queue->stat->next = s_queue_stat_list;
+        s_queue_stat_list = queue->stat;
+        pthread_mutex_unlock(&s_queue_stat_lock);
+    }
+
+    *handle = (TKL_QUEUE_HANDLE)queue;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief post a message to the message queue
+ *
+ * @param[in] queue the handle of the queue
+ * @param[in] data the data of the message
+ * @param[in] timeout timeout time
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_post(const TKL_QUEUE_HANDLE handle, void *data, uint32_t timeout)
+{
+    return tkl_queue_post_prio(handle, data, 0, timeout);
+}
+
+/**
+ * @brief post a message to the message queue at a priority level
+ *
+ * @param[in] queue the handle of the queue
+ * @param[in] data the data of the message
+ * @param[in] prio the level, the highest level is fetched first, above it is taken as the highest
+ * @param[in] timeout timeout time
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note a queue without TKL_QUEUE_FLAG_PRIO ignores prio
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_post_prio(const TKL_QUEUE_HANDLE handle, void *data, uint32_t prio, uint32_t timeout)
+{
+    if (NULL == handle || NULL == data) {
+        return OPRT_INVALID_PARM;
+    }
+
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+    int wait_ms      = 0;
+    void *buf        = data;
+
+    if (timeout == TKL_QUEUE_WAIT_FROEVER) {
+        wait_ms = RPA_WAIT_FOREVER;
+    } else {
+        wait_ms = timeout;
+    }
+
+    if (queue->lf) {
+        if (!lf_queue_timedpush(queue->lf, buf, wait_ms)) {
+            return OPRT_OS_ADAPTER_QUEUE_SEND_FAIL;
+        }
+        queue_stat_move(queue->stat, TRUE, 1);
+        return OPRT_OK;
+    }
+
+    // an inline queue copies the message into its slot
+    if (queue->flags & TKL_QUEUE_FLAG_INLINE) {
+        if (!rpa_queue_timedpush(queue->queue, buf, prio, wait_ms)) {
+            return OPRT_OS_ADAPTER_QUEUE_SEND_FAIL;
+        }
+        queue_stat_move(queue->stat, TRUE, 1);
+        return OPRT_OK;
+    }
+
+    buf = (void *)malloc(queue->msgsize);
+    if (NULL == buf) {
+        return OPRT_MALLOC_FAILED;
+    }
+
+    memcpy(buf, (void *)data, queue->msgsize);
+
+    if (!rpa_queue_timedpush(queue->queue, buf, prio, wait_ms)) {
+        free(buf);
+        return OPRT_OS_ADAPTER_QUEUE_SEND_FAIL;
+    }
+
+    queue_stat_move(queue->stat, TRUE, 1);
+    return OPRT_OK;
+}
+
+/**
+ * @brief fetch message from the message queue
+ *
+ * @param[in] queue the message queue handle
+ * @param[inout] msg the message fetch form the message queue
+ * @param[in] timeout timeout time
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_fetch(const TKL_QUEUE_HANDLE handle, void *msg, uint32_t timeout)
+{
+    if (NULL == handle) {
+        return OPRT_INVALID_PARM;
+    }
+
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+    void *buf        = NULL;
+    int wait_ms;
+
+    if (timeout == TKL_QUEUE_WAIT_FROEVER) {
+        wait_ms = RPA_WAIT_FOREVER;
+    } else {
+        wait_ms = timeout;
+    }
+
+    if (queue->lf) {
+        if (!lf_queue_timedpop(queue->lf, msg, wait_ms)) {
+            return OPRT_OS_ADAPTER_QUEUE_RECV_FAIL;
+        }
+        queue_stat_move(queue->stat, FALSE, 1);
+        return OPRT_OK;
+    }
+
+    if (queue->flags & TKL_QUEUE_FLAG_INLINE) {
+        if (!rpa_queue_timedpop(queue->queue, (void **)msg, wait_ms)) {
+            return OPRT_OS_ADAPTER_QUEUE_RECV_FAIL;
+        }
+        queue_stat_move(queue->stat, FALSE, 1);
+        return OPRT_OK;
+    }
+
+    if (!rpa_queue_timedpop(queue->queue, (void **)&buf, wait_ms)) {
+        return OPRT_OS_ADAPTER_QUEUE_RECV_FAIL;
+    }
+
+    if (buf) {
+        memcpy((void *)msg, buf, queue->msgsize);
+        free(buf);
+    }
+
+    queue_stat_move(queue->stat, FALSE, 1);
+    return OPRT_OK;
+}
+
+/**
+ * @brief free the message queue
+ *
+ * @param[in] queue the message queue handle
+ *
+ * @return void
+ */
+TUYA_WEAK_ATTRIBUTE void tkl_queue_free(const TKL_QUEUE_HANDLE handle)
+{
+    if (NULL == handle) {
+        return;
+    }
+
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+    queue_stat_t **pp = NULL;
+
+    if (queue->stat) {
+        pthread_mutex_lock(&s_queue_stat_lock);
+        for (pp = &s_queue_stat_list; *pp; pp = &(*pp)->next) {
+            if (*pp == queue->stat) {
+                *pp = queue->stat->next;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&s_queue_stat_lock);
+        free(queue->stat);
+    }
+
+    if (queue->lf) {
+        lf_queue_destroy(queue->lf);
+    } else {
+        rpa_queue_destroy(queue->queue);
+    }
+    free(queue);
+}
+
+/**
+ * @brief post many messages to the message queue under one lock and one wakeup
+ *
+ * @param[in] queue the handle of the queue
+ * @param[in] data count messages of msgsize bytes each, back to back
+ * @param[in] count the number of messages
+ * @param[in] timeout timeout time, waited only while the queue is full
+ * @param[out] posted the number of messages posted, always the leading ones of data, may be NULL
+ *
+ * @return OPRT_OK if at least one message was posted. Others on error, please refer to tuya_error_code.h
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_post_batch(const TKL_QUEUE_HANDLE handle, void *data, uint32_t count, uint32_t timeout, uint32_t *posted)
+{
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+    void **bufs = NULL;
+    uint32_t n = 0, i = 0;
+    int wait_ms = 0;
+
+    if (posted) {
+        *posted = 0;
+    }
+    if (NULL == handle || NULL == data || 0 == count) {
+        return OPRT_INVALID_PARM;
+    }
+
+    if (timeout == TKL_QUEUE_WAIT_FROEVER) {
+        wait_ms = RPA_WAIT_FOREVER;
+    } else {
+        wait_ms = timeout;
+    }
+
+    if (queue->lf) {
+        n = lf_queue_timedpush_batch(queue->lf, data, count, wait_ms);
+    } else if (queue->flags & TKL_QUEUE_FLAG_INLINE) {
+        n = rpa_queue_timedpush_batch(queue->queue, data, count, wait_ms);
+    } else {
+        // no more copies than could ever fit
+        if (count > queue->queue->bounds) {
+            count = queue->queue->bounds;
+        }
+        bufs = (void **)malloc(count * sizeof(void *));
+        if (NULL == bufs) {
+            return OPRT_MALLOC_FAILED;
+        }
+        for (i = 0; i < count; i++) {
+            bufs[i] = malloc(queue->msgsize);
+            if (NULL == bufs[i]) {
+                break;
+            }
+            memcpy(bufs[i], (uint8_t *)data + (size_t)i * queue->msgsize, queue->msgsize);
+        }
+        if (i) {
+            n = rpa_queue_timedpush_batch(queue->queue, bufs, i, wait_ms);
+        }
+        while (i > n) {
+            free(bufs[--i]);
+        }
+        free(bufs);
+        if (0 == n && i < count) {
+            return OPRT_MALLOC_FAILED;
+        }
+    }
+
+    if (posted) {
+        *posted = n;
+    }
+    queue_stat_move(queue->stat, TRUE, n);
+
+    return n ? OPRT_OK : OPRT_OS_ADAPTER_QUEUE_SEND_FAIL;
+}
+
+/**
+ * @brief fetch many messages from the message queue under one lock and one wakeup
+ *
+ * @param[in] queue the message queue handle
+ * @param[out] buf room for max messages of msgsize bytes each
+ * @param[in] max the most messages to fetch
+ * @param[in] timeout timeout time, waited only while the queue is empty
+ * @param[out] got the number of messages fetched
+ *
+ * @return OPRT_OK if at least one message was fetched. Others on error, please refer to tuya_error_code.h
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_fetch_batch(const TKL_QUEUE_HANDLE handle, void *buf, uint32_t max, uint32_t timeout, uint32_t *got)
+{
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+    void *ptrs[TKL_QUEUE_BATCH_PTRS];
+    uint32_t n = 0, i = 0;
+    int wait_ms = 0;
+
+    if (NULL == handle || NULL == buf || 0 == max || NULL == got) {
+        return OPRT_INVALID_PARM;
+    }
+    *got = 0;
+
+    if (timeout == TKL_QUEUE_WAIT_FROEVER) {
+        wait_ms = RPA_WAIT_FOREVER;
+    } else {
+        wait_ms = timeout;
+    }
+
+    if (queue->lf) {
+        n = lf_queue_timedpop_batch(queue->lf, buf, max, wait_ms);
+    } else if (queue->flags & TKL_QUEUE_FLAG_INLINE) {
+        n = rpa_queue_timedpop_batch(queue->queue, buf, max, wait_ms);
+    } else {
+        n = rpa_queue_timedpop_batch(queue->queue, ptrs, (max < TKL_QUEUE_BATCH_PTRS) ? max : TKL_QUEUE_BATCH_PTRS, wait_ms);
+        for (i = 0; i < n; i++) {
+            memcpy((uint8_t *)buf + (size_t)i * queue->msgsize, ptrs[i], queue->msgsize);
+            free(ptrs[i]);
+        }
+    }
+
+    *got = n;
+    queue_stat_move(queue->stat, FALSE, n);
+
+    return n ? OPRT_OK : OPRT_OS_ADAPTER_QUEUE_RECV_FAIL;
+}
+
+/**
+ * @brief reserve the next message slot of the queue, to be filled in place
+ *
+ * @param[in] queue the handle of the queue
+ * @param[out] msg the slot, msgsize bytes
+ * @param[in] timeout timeout time, waited only while the queue is full
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note only for TKL_QUEUE_FLAG_MPMC and TKL_QUEUE_FLAG_SPSC queues
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_loan(const TKL_QUEUE_HANDLE handle, void **msg, uint32_t timeout)
+{
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+    int wait_ms = 0;
+
+    if (NULL == handle || NULL == msg) {
+        return OPRT_INVALID_PARM;
+    }
+    if (NULL == queue->lf) {
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    if (timeout == TKL_QUEUE_WAIT_FROEVER) {
+        wait_ms = RPA_WAIT_FOREVER;
+    } else {
+        wait_ms = timeout;
+    }
+
+    if (!lf_queue_wait(queue->lf, lf_queue_tryloan, msg, &queue->lf->not_full, wait_ms)) {
+        return OPRT_OS_ADAPTER_QUEUE_SEND_FAIL;
+    }
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief post a slot got by tkl_queue_loan
+ *
+ * @param[in] queue the handle of the queue
+ * @param[in] msg the slot
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_commit(const TKL_QUEUE_HANDLE handle, void *msg)
+{
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+
+    if (NULL == handle || NULL == msg) {
+        return OPRT_INVALID_PARM;
+    }
+    if (NULL == queue->lf) {
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    lf_queue_publish_in(queue->lf, (uint8_t *)msg);
+    lf_event_signal(&queue->lf->not_empty);
+    queue_stat_move(queue->stat, TRUE, 1);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief take the oldest message of the queue in place
+ *
+ * @param[in] queue the message queue handle
+ * @param[out] msg the slot holding the message, msgsize bytes
+ * @param[in] timeout timeout time, waited only while the queue is empty
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note only for TKL_QUEUE_FLAG_MPMC and TKL_QUEUE_FLAG_SPSC queues
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_borrow(const TKL_QUEUE_HANDLE handle, void **msg, uint32_t timeout)
+{
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+    int wait_ms = 0;
+
+    if (NULL == handle || NULL == msg) {
+        return OPRT_INVALID_PARM;
+    }
+    if (NULL == queue->lf) {
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    if (timeout == TKL_QUEUE_WAIT_FROEVER) {
+        wait_ms = RPA_WAIT_FOREVER;
+    } else {
+        wait_ms = timeout;
+    }
+
+    if (!lf_queue_wait(queue->lf, lf_queue_tryborrow, msg, &queue->lf->not_empty, wait_ms)) {
+        return OPRT_OS_ADAPTER_QUEUE_RECV_FAIL;
+    }
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief give back a slot got by tkl_queue_borrow
+ *
+ * @param[in] queue the message queue handle
+ * @param[in] msg the slot
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_release(const TKL_QUEUE_HANDLE handle, void *msg)
+{
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+
+    if (NULL == handle || NULL == msg) {
+        return OPRT_INVALID_PARM;
+    }
+    if (NULL == queue->lf) {
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    lf_queue_publish_out(queue->lf, (uint8_t *)msg);
+    lf_event_signal(&queue->lf->not_full);
+    queue_stat_move(queue->stat, FALSE, 1);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief name the queue in its statistics
+ *
+ * @param[in] queue the message queue handle
+ * @param[in] name the name, cut to TKL_QUEUE_NAME_MAX - 1 chars
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_set_name(const TKL_QUEUE_HANDLE handle, const char *name)
+{
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+
+    if (NULL == handle || NULL == name) {
+        return OPRT_INVALID_PARM;
+    }
+    if (NULL == queue->stat) {
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    pthread_mutex_lock(&s_queue_stat_lock);
+    strncpy(queue->stat->pub.name, name, TKL_QUEUE_NAME_MAX - 1);
+    queue->stat->pub.name[TKL_QUEUE_NAME_MAX - 1] = '\0';
+    pthread_mutex_unlock(&s_queue_stat_lock);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief get the statistics of a queue created with TKL_QUEUE_FLAG_STATS
+ *
+ * @param[in] queue the message queue handle
+ * @param[out] stat the statistics
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_stat_get(const TKL_QUEUE_HANDLE handle, TKL_QUEUE_STAT_T *stat)
+{
+    TKL_QUEUE_T *queue = (TKL_QUEUE_T *)handle;
+
+    if (NULL == handle || NULL == stat) {
+        return OPRT_INVALID_PARM;
+    }
+    if (NULL == queue->stat) {
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    pthread_mutex_lock(&s_queue_stat_lock);
+    queue_stat_read(queue->stat, stat);
+    pthread_mutex_unlock(&s_queue_stat_lock);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief call cb with the statistics of every queue created with TKL_QUEUE_FLAG_STATS
+ *
+ * @param[in] cb the callback
+ * @param[in] arg passed to cb
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ *
+ * @note cb runs with the queue list locked, it must not create or free queues
+ */
+TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_queue_stat_foreach(TKL_QUEUE_STAT_CB cb, void *arg)
+{
+    TKL_QUEUE_STAT_T stat;
+    queue_stat_t *node = NULL;
+
+    if (NULL == cb) {
+        return OPRT_INVALID_PARM;
+    }
+
+    pthread_mutex_lock(&s_queue_stat_lock);
+    for (node = s_queue_stat_list; node; node = node->next) {
+        queue_stat_read(node, &stat);
+        cb(&stat, arg);
+    }
+    pthread_mutex_unlock(&s_queue_stat_lock);
+
+    return OPRT_OK;
 }
@@ -11,6 +11,7 @@
 #include "tuya_iot_config.h"
 #include "tkl_thread.h"
 #include "tkl_memory.h"
+#include "tuya_mem_pool.h"
 #include <pthread.h>
 #include <sys/prctl.h>
 #include <string.h>
@@ -21,6 +22,36 @@ typedef struct {
     void*         arg;
 } THREAD_DATA;
 
+/* thread data carved from the pool at once */
+#ifndef THREAD_DATA_POOL_NUM
+#define THREAD_DATA_POOL_NUM 8
+#endif
+
+static MEM_POOL_HANDLE s_thread_pool = NULL;
+
+/* created by the first thread, a failed create is tried again by the next one */
+static MEM_POOL_HANDLE _tkl_thread_pool_get(void)
+{
+    MEM_POOL_HANDLE pool = __atomic_load_n(&s_thread_pool, __ATOMIC_ACQUIRE);
+    MEM_POOL_HANDLE expect = NULL;
+
+    if (pool) {
+        return pool;
+    }
+
+    if (OPRT_OK != tuya_mem_pool_create(sizeof(THREAD_DATA), THREAD_DATA_POOL_NUM, &pool)) {
+        return NULL;
+    }
+
+    // lost the race, use the pool published by others
+    if (!__atomic_compare_exchange_n(&s_thread_pool, &expect, pool, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        tuya_mem_pool_release(pool);
+        pool = expect;
+    }
+
+    return pool;
+}
+
 static void* _tkl_thread_wrap_func(void* arg)
 {
     THREAD_DATA* thread_data = (THREAD_DATA*)arg;
@@ -57,7 +88,11 @@ TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_thread_create(TKL_THREAD_HANDLE* thread,
     }
     
     int ret = 0;
-    THREAD_DATA* thread_data = (THREAD_DATA*)tkl_system_malloc(sizeof(THREAD_DATA));
+    MEM_POOL_HANDLE pool = _tkl_thread_pool_get();
+    if (pool == NULL) {
+       return OPRT_MALLOC_FAILED;
+    }
+    THREAD_DATA* thread_data = (THREAD_DATA*)tuya_mem_pool_alloc(pool);
     if (thread_data == NULL) {
        return OPRT_MALLOC_FAILED;
     }
@@ -75,6 +110,7 @@ TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_thread_create(TKL_THREAD_HANDLE* thread,
     ret = pthread_create(&(thread_data->id) ,&attr, _tkl_thread_wrap_func, thread_data);
     pthread_attr_destroy(&attr);
     if (0 != ret) {
+        tuya_mem_pool_free(pool, thread_data);
         return OPRT_OS_ADAPTER_THRD_CREAT_FAILED;
     }
         
@@ -98,7 +134,7 @@ TUYA_WEAK_ATTRIBUTE OPERATE_RET tkl_thread_release(TKL_THREAD_HANDLE thread)
     }
     
     THREAD_DATA* thread_data = (THREAD_DATA*)thread;
-    tkl_system_free(thread_data);
+    tuya_mem_pool_free(s_thread_pool, thread_data);
     
     return OPRT_OK;
 }